@@ -0,0 +1,79 @@
+// throughput of on_output rule matching over log-like text.
+// build with -DTHORFINN_BUILD_BENCHMARKS=ON and run ./output_matcher_bench [megabytes]
+#include "output_matcher.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string generateLog(size_t bytes) {
+    static const char* levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN"};
+    static const char* messages[] = {
+        "request handled path=/api/v1/items status=200",
+        "cache miss for key user:session:4821, fetching from backend",
+        "connection pool stats active=12 idle=4 waiting=0",
+        "query finished in 14 ms",
+        "retrying upload of chunk 17/64 after timeout",
+        "scheduled job compaction started",
+    };
+    std::mt19937 rng(42);
+    std::string log;
+    log.reserve(bytes + 256);
+    unsigned line = 0;
+    while (log.size() < bytes) {
+        log += "2026-10-19T03:14:";
+        log += std::to_string(10 + rng() % 50);
+        log += ".";
+        log += std::to_string(100 + rng() % 900);
+        log += " [";
+        // roughly one real hit every few thousand lines
+        if (++line % 4000 == 0) {
+            log += "ERROR] worker 3 failed: FATAL panic: 128 rows lost\n";
+            continue;
+        }
+        log += levels[rng() % 5];
+        log += "] ";
+        log += messages[rng() % 6];
+        log += "\n";
+    }
+    return log;
+}
+
+static void run(const std::string& name, const std::vector<std::string>& patterns, bool regex, const std::string& log) {
+    std::vector<OutputRule> rules;
+    for (const auto& pattern : patterns) {
+        OutputRule rule;
+        rule.pattern = pattern;
+        rule.regex = regex;
+        if (regex) {
+            rule.compiled = std::make_shared<const std::regex>(pattern, std::regex::ECMAScript | std::regex::optimize);
+        }
+        rules.push_back(rule);
+    }
+
+    size_t hits = 0;
+    Thorfinn::OutputMatcher::Scanner scanner(rules, [&hits](const OutputRule&, const std::string&) { ++hits; });
+    const size_t chunk = 0x10000; // what the pipeline reads per call
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < log.size(); offset += chunk) {
+        scanner.feed(log.data() + offset, std::min(chunk, log.size() - offset));
+    }
+    scanner.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << log.size() / seconds / 1e9 << " GB/s (" << hits << " hits)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    std::string log = generateLog(megabytes << 20);
+
+    run("3 literals", {"FATAL", "listening on", "panic:"}, false, log);
+    run("regex \\bFATAL\\b", {"\\bFATAL\\b"}, true, log);
+    run("regex .*panic", {".*panic"}, true, log);
+    run("regex (ERROR|FATAL)", {"(ERROR|FATAL)"}, true, log);
+    run("regex [0-9]+ rows", {"[0-9]+ rows"}, true, log);
+    run("regex [A-Z]{5}\\] (no literal)", {"[A-Z]{5}\\]"}, true, log);
+    return 0;
+}
@@ -1,12 +1,22 @@
 #include "config.h"
+#include "logger.h"
 #include <fstream>
-#include <iostream>
 #include <yaml-cpp/yaml.h>
 
 Config Config::loadFromFile(const std::string& filepath) {
     Config config;
+    loadFromFile(filepath, config);
+    return config;
+}
+
+bool Config::loadFromFile(const std::string& filepath, Config& config) {
     try {
         YAML::Node root = YAML::LoadFile(filepath);
+        // an empty or half written file parses fine, it just isn't a config
+        if (!root.IsMap()) {
+            Thorfinn::Log::error() << "Error loading config file: " << filepath << " does not contain a YAML mapping.";
+            return false;
+        }
 
         if (root["name"]) config.name = root["name"].as<std::string>();
         if (root["description"]) config.description = root["description"].as<std::string>();
@@ -18,6 +28,12 @@ Config Config::loadFromFile(const std::string& filepath) {
             if (root["ssh_global_config"]["password"]) config.ssh_global_config.password = root["ssh_global_config"]["password"].as<std::string>();
         }
 
+        if (root["log"]) {
+            if (root["log"]["level"]) config.log.level = root["log"]["level"].as<std::string>();
+            if (root["log"]["format"]) config.log.format = root["log"]["format"].as<std::string>();
+            if (root["log"]["file"]) config.log.file = root["log"]["file"].as<std::string>();
+        }
+
         if (root["triggers"] && root["triggers"].IsSequence()) {
             for (const auto& trigger : root["triggers"]) {
                 config.triggers.push_back(trigger.as<std::map<std::string, std::string>>());
@@ -58,11 +74,47 @@ Config Config::loadFromFile(const std::string& filepath) {
                         step.on_failure.push_back(action.as<std::map<std::string, std::string>>());
                     }
                 }
+                if (step_node["on_output"] && step_node["on_output"].IsSequence()) {
+                    for (const auto& rule_node : step_node["on_output"]) {
+                        OutputRule rule;
+                        if (rule_node["match"]) {
+                            rule.pattern = rule_node["match"].as<std::string>();
+                        } else if (rule_node["regex"]) {
+                            rule.pattern = rule_node["regex"].as<std::string>();
+                            rule.regex = true;
+                        }
+                        if (rule.pattern.empty()) {
+                            Thorfinn::Log::warn() << "Warning: on_output rule in step '" << step.name << "' has no 'match' or 'regex', ignoring it.";
+                            continue;
+                        }
+                        if (rule_node["abort"]) rule.abort = rule_node["abort"].as<bool>();
+                        if (rule_node["actions"] && rule_node["actions"].IsSequence()) {
+                            for (const auto& action : rule_node["actions"]) {
+                                rule.actions.push_back(action.as<std::map<std::string, std::string>>());
+                            }
+                        }
+                        if (rule.regex) {
+                            try {
+                                rule.compiled = std::make_shared<const std::regex>(rule.pattern, std::regex::ECMAScript | std::regex::optimize);
+                            } catch (const std::regex_error& e) {
+                                Thorfinn::Log::warn() << "Warning: Invalid regex '" << rule.pattern << "' in step '" << step.name << "': " << e.what() << ", ignoring it.";
+                                continue;
+                            }
+                        }
+                        step.on_output.push_back(rule);
+                    }
+                }
                 if (step_node["ssh_config"] && step_node["ssh_config"].IsMap()) {
                     for (YAML::const_iterator it = step_node["ssh_config"].begin(); it != step_node["ssh_config"].end(); ++it) {
                         step.ssh_config[it->first.as<std::string>()] = it->second.as<std::string>();
                     }
                 }
+                if (step_node["isolated"]) step.isolated = step_node["isolated"].as<bool>();
+                if (step_node["outputs"] && step_node["outputs"].IsSequence()) {
+                    for (const auto& output : step_node["outputs"]) {
+                        step.outputs.push_back(output.as<std::string>());
+                    }
+                }
                 config.steps.push_back(step);
             }
         }
@@ -74,9 +126,10 @@ Config Config::loadFromFile(const std::string& filepath) {
         }
 
     } catch (const YAML::Exception& e) {
-        std::cerr << "Error loading config file: " << e.what() << std::endl;
+        Thorfinn::Log::error() << "Error loading config file: " << e.what();
+        return false;
     }
-    return config;
+    return true;
 }
 
 bool Config::saveToFile(const std::string& filepath) const {
@@ -93,6 +146,14 @@ bool Config::saveToFile(const std::string& filepath) const {
         out << YAML::Key << "password" << YAML::Value << ssh_global_config.password;
         out << YAML::EndMap;
 
+        out << YAML::Key << "log" << YAML::Value << YAML::BeginMap;
+        out << YAML::Key << "level" << YAML::Value << log.level;
+        out << YAML::Key << "format" << YAML::Value << log.format;
+        if (!log.file.empty()) {
+            out << YAML::Key << "file" << YAML::Value << log.file;
+        }
+        out << YAML::EndMap;
+
         out << YAML::Key << "triggers" << YAML::Value << YAML::BeginSeq;
         for (const auto& trigger : triggers) {
             out << trigger;
@@ -133,9 +194,34 @@ bool Config::saveToFile(const std::string& filepath) const {
                 }
                 out << YAML::EndSeq;
             }
+            if (!step.on_output.empty()) {
+                out << YAML::Key << "on_output" << YAML::Value << YAML::BeginSeq;
+                for (const auto& rule : step.on_output) {
+                    out << YAML::BeginMap;
+                    out << YAML::Key << (rule.regex ? "regex" : "match") << YAML::Value << rule.pattern;
+                    if (rule.abort) {
+                        out << YAML::Key << "abort" << YAML::Value << true;
+                    }
+                    if (!rule.actions.empty()) {
+                        out << YAML::Key << "actions" << YAML::Value << YAML::BeginSeq;
+                        for (const auto& action : rule.actions) {
+                            out << action;
+                        }
+                        out << YAML::EndSeq;
+                    }
+                    out << YAML::EndMap;
+                }
+                out << YAML::EndSeq;
+            }
             if (!step.ssh_config.empty()) {
                 out << YAML::Key << "ssh_config" << YAML::Value << step.ssh_config;
             }
+            if (step.isolated) {
+                out << YAML::Key << "isolated" << YAML::Value << true;
+            }
+            if (!step.outputs.empty()) {
+                out << YAML::Key << "outputs" << YAML::Value << YAML::Flow << step.outputs;
+            }
             out << YAML::EndMap;
         }
         out << YAML::EndSeq;
@@ -153,11 +239,11 @@ bool Config::saveToFile(const std::string& filepath) const {
             fout << out.c_str();
             return true;
         } else {
-            std::cerr << "Error opening file for writing: " << filepath << std::endl;
+            Thorfinn::Log::error() << "Error opening file for writing: " << filepath;
             return false;
         }
     } catch (const YAML::Exception& e) {
-        std::cerr << "Error saving config file: " << e.what() << std::endl;
+        Thorfinn::Log::error() << "Error saving config file: " << e.what();
         return false;
     }
 }
\ No newline at end of file
@@ -4,15 +4,28 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <regex>
 #include <yaml-cpp/yaml.h>
 
+struct OutputRule {
+    std::string pattern;
+    bool regex = false;
+    bool abort = false; // terminate the step when the pattern shows up
+    std::vector<std::map<std::string, std::string>> actions;
+    std::shared_ptr<const std::regex> compiled; // set for regex rules when the config is loaded
+};
+
 struct Step {
     std::string name;
     std::string run;
     std::vector<std::string> dependencies;
     std::vector<std::map<std::string, std::string>> on_success;
     std::vector<std::map<std::string, std::string>> on_failure;
+    std::vector<OutputRule> on_output;
     std::map<std::string, std::string> ssh_config;
+    bool isolated = false; // run in a private workspace, only 'outputs' are merged back
+    std::vector<std::string> outputs;
 };
 
 struct SSHGlobalConfig {
@@ -22,10 +35,19 @@ struct SSHGlobalConfig {
     std::string password;
 };
 
+struct LogConfig {
+    std::string level = "info";   // debug, info, warn, error
+    std::string format = "text";  // text, json
+    std::string file;             // empty logs to the terminal
+};
+
 struct EventTrigger {
     std::string type;
     std::string description;
     std::map<std::string, std::string> config;
+
+    // two triggers are the same source if they watch the same thing; description is cosmetic
+    bool sameSourceAs(const EventTrigger& other) const { return type == other.type && config == other.config; }
 };
 
 struct Config {
@@ -36,8 +58,10 @@ struct Config {
     std::vector<Step> steps;
     std::vector<std::map<std::string, std::string>> results;
     SSHGlobalConfig ssh_global_config;
+    LogConfig log;
 
     static Config loadFromFile(const std::string& filepath);
+    static bool loadFromFile(const std::string& filepath, Config& config);
     bool saveToFile(const std::string& filepath) const;
 };
 
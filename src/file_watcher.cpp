@@ -1,5 +1,5 @@
 #include "file_watcher.h"
-#include <iostream>
+#include "logger.h"
 #include <fstream>
 #include <chrono>
 #include <thread>
@@ -20,36 +20,43 @@ std::map<std::string, fs::file_time_type> getCurrentDirectoryState(const std::st
             }
         }
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error getting directory state for " << directoryPath << ": " << e.what() << std::endl;
+        Log::error() << "Filesystem error getting directory state for " << directoryPath << ": " << e.what();
     }
     return current_state;
 }
 
 
-void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback callback) {
+static bool isRunning(const RunningFlag& running) {
+    return !running || running->load();
+}
+
+void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback callback, RunningFlag running) {
     // todo: implement subdirectory watching
-    std::thread([directoryPath, callback]() {
+    std::thread([directoryPath, callback, running]() {
         if (!fs::exists(directoryPath) || !fs::is_directory(directoryPath)) {
-            std::cerr << "Error: Directory not found or is not a directory: " << directoryPath << std::endl;
+            Log::error() << "Error: Directory not found or is not a directory: " << directoryPath;
             return;
         }
 
         std::map<std::string, fs::file_time_type> last_state = getCurrentDirectoryState(directoryPath);
 
-        while (true) {
+        while (isRunning(running)) {
             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            if (!isRunning(running)) {
+                break;
+            }
 
             std::map<std::string, fs::file_time_type> current_state = getCurrentDirectoryState(directoryPath);
 
             for (const auto& [path, current_time] : current_state) {
                 auto it = last_state.find(path);
                 if (it == last_state.end()) {
-                    std::cout << "Detected file created: " << path << std::endl;
+                    Log::info() << "Detected file created: " << path;
                     if (callback) {
                         callback(FileSystemEventType::Created, path);
                     }
                 } else if (it->second != current_time) {
-                    std::cout << "Detected file modified: " << path << std::endl;
+                    Log::info() << "Detected file modified: " << path;
                     if (callback) {
                         callback(FileSystemEventType::Modified, path);
                     }
@@ -58,7 +65,7 @@ void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback c
 
             for (const auto& [path, last_time] : last_state) {
                 if (current_state.find(path) == current_state.end()) {
-                    std::cout << "Detected file deleted: " << path << std::endl;
+                    Log::info() << "Detected file deleted: " << path;
                     if (callback) {
                         callback(FileSystemEventType::Deleted, path);
                     }
@@ -69,5 +76,64 @@ void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback c
         }
     }).detach(); 
 }
+
+struct FileSnapshot {
+    bool exists = false;
+    fs::file_time_type time = fs::file_time_type::min();
+    std::uintmax_t size = 0;
+
+    bool operator==(const FileSnapshot& other) const { return exists == other.exists && time == other.time && size == other.size; }
+    bool operator!=(const FileSnapshot& other) const { return !(*this == other); }
+};
+
+// false if the file changed between the calls, the next poll will catch it
+static bool snapshotFile(const std::string& filePath, FileSnapshot& snapshot) {
+    std::error_code ec;
+    snapshot = FileSnapshot();
+    snapshot.exists = fs::is_regular_file(filePath, ec);
+    if (snapshot.exists) {
+        snapshot.time = fs::last_write_time(filePath, ec);
+        snapshot.size = fs::file_size(filePath, ec);
+    }
+    return !ec;
+}
+
+void watchFile(const std::string& filePath, FileSystemChangeCallback callback, RunningFlag running) {
+    std::thread([filePath, callback, running]() {
+        FileSnapshot reported;
+        snapshotFile(filePath, reported);
+        FileSnapshot previous = reported;
+
+        while (isRunning(running)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            if (!isRunning(running)) {
+                break;
+            }
+
+            FileSnapshot current;
+            if (!snapshotFile(filePath, current)) {
+                continue;
+            }
+            // only report once mtime and size held still for a whole poll, so a file that's
+            // truncated and then written back by an editor shows up as a single change
+            bool settled = current == previous;
+            previous = current;
+            if (!settled || current == reported) {
+                continue;
+            }
+
+            FileSystemEventType eventType = FileSystemEventType::Modified;
+            if (current.exists && !reported.exists) {
+                eventType = FileSystemEventType::Created;
+            } else if (!current.exists) {
+                eventType = FileSystemEventType::Deleted;
+            }
+            reported = current;
+            if (callback) {
+                callback(eventType, filePath);
+            }
+        }
+    }).detach();
+}
 }
 }
\ No newline at end of file
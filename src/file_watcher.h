@@ -5,6 +5,8 @@
 #include <functional>
 #include <map>
 #include <filesystem>
+#include <atomic>
+#include <memory>
 
 namespace Thorfinn {
 namespace FileWatcher {
@@ -16,9 +18,12 @@ enum class FileSystemEventType {
 };
 
 using FileSystemChangeCallback = std::function<void(FileSystemEventType, const std::string&)>;
+// watchers keep polling while the flag is set; pass nullptr to watch forever
+using RunningFlag = std::shared_ptr<std::atomic<bool>>;
 
-void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback callback);
-void watchFile(const std::string& filePath, FileSystemChangeCallback callback); // todo: implement file_change type
+void watchDirectory(const std::string& directoryPath, FileSystemChangeCallback callback, RunningFlag running = nullptr);
+// reports a change once the file has stopped changing for one poll
+void watchFile(const std::string& filePath, FileSystemChangeCallback callback, RunningFlag running = nullptr);
 
 }}
 
@@ -0,0 +1,410 @@
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace Thorfinn {
+namespace Log {
+
+struct Record {
+    uint64_t seq = 0;
+    std::chrono::system_clock::time_point time;
+    Level level = Level::Info;
+    bool spaced = false;
+    unsigned thread = 0;
+    std::string run;
+    std::string step;
+    std::string message;
+};
+
+// single producer (the owning thread), single consumer (the writer thread)
+class RecordRing {
+public:
+    static const size_t CAPACITY = 1024;
+
+    bool push(Record& record) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        slots_[tail % CAPACITY] = std::move(record);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Record& record) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        record = std::move(slots_[head % CAPACITY]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    Record slots_[CAPACITY];
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
+
+struct ThreadBuffer {
+    RecordRing ring;
+    std::atomic<bool> alive{true};
+    unsigned id = 0;
+    std::string run;
+    std::string step;
+};
+
+struct Settings {
+    Level minLevel = Level::Info;
+    Format format = Format::Text;
+    std::string filePath;
+};
+
+// never destroyed on purpose: forked children run static destructors on exit, and they must not
+// touch a writer thread that only exists in the parent
+struct Logger {
+    std::atomic<int> minLevel{static_cast<int>(Level::Info)};
+    std::atomic<uint64_t> nextSeq{0};
+    std::atomic<unsigned> nextThreadId{0};
+
+    std::mutex registryMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::atomic<bool> writerIdle{false};
+    std::atomic<uint64_t> flushTicket{0};
+    uint64_t completedTicket = 0;
+    bool stopping = false;
+    std::thread writer;
+    std::once_flag started;
+
+    std::mutex settingsMutex;
+    Settings settings;
+    FILE* file = nullptr;
+    std::string openPath;
+};
+
+static Logger& logger() {
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+struct ThreadBufferHolder {
+    std::shared_ptr<ThreadBuffer> buffer;
+    ~ThreadBufferHolder() {
+        if (buffer) {
+            // the writer drops the buffer once it has drained what's left
+            buffer->alive.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static ThreadBuffer& threadBuffer() {
+    thread_local ThreadBufferHolder holder;
+    if (!holder.buffer) {
+        Logger& log = logger();
+        holder.buffer = std::make_shared<ThreadBuffer>();
+        holder.buffer->id = log.nextThreadId++;
+        std::lock_guard<std::mutex> lock(log.registryMutex);
+        log.buffers.push_back(holder.buffer);
+    }
+    return *holder.buffer;
+}
+
+static const char* levelName(Level level) {
+    switch (level) {
+        case Level::Debug: return "debug";
+        case Level::Info:  return "info";
+        case Level::Warn:  return "warn";
+        case Level::Error: return "error";
+    }
+    return "info";
+}
+
+static void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+static void appendTimestamp(std::string& out, std::chrono::system_clock::time_point time) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+    out += buffer;
+    snprintf(buffer, sizeof(buffer), ".%03dZ", static_cast<int>(millis));
+    out += buffer;
+}
+
+static void formatRecord(std::string& out, const Record& record, const Settings& settings, bool toFile) {
+    if (settings.format == Format::Json) {
+        out += "{\"ts\":\"";
+        appendTimestamp(out, record.time);
+        out += "\",\"level\":\"";
+        out += levelName(record.level);
+        out += "\",\"thread\":";
+        out += std::to_string(record.thread);
+        if (!record.run.empty()) {
+            out += ",\"run\":";
+            appendJsonString(out, record.run);
+        }
+        if (!record.step.empty()) {
+            out += ",\"step\":";
+            appendJsonString(out, record.step);
+        }
+        out += ",\"msg\":";
+        appendJsonString(out, record.message);
+        out += "}\n";
+        return;
+    }
+    // the terminal keeps the plain look it always had, files get a timestamp and level to grep by
+    if (toFile) {
+        appendTimestamp(out, record.time);
+        out += ' ';
+        out += levelName(record.level);
+        out += ' ';
+    } else if (record.spaced) {
+        out += '\n';
+    }
+    out += record.message;
+    out += '\n';
+}
+
+static void writeBatch(Logger& log, std::vector<Record>& batch) {
+    std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) { return a.seq < b.seq; });
+
+    std::lock_guard<std::mutex> lock(log.settingsMutex);
+    if (log.openPath != log.settings.filePath) {
+        if (log.file) {
+            fclose(log.file);
+            log.file = nullptr;
+        }
+        log.openPath = log.settings.filePath;
+        if (!log.openPath.empty()) {
+            log.file = fopen(log.openPath.c_str(), "a");
+            if (!log.file) {
+                fprintf(stderr, "Error: Could not open log file %s, logging to the terminal.\n", log.openPath.c_str());
+            }
+        }
+    }
+
+    if (log.file) {
+        std::string out;
+        for (const auto& record : batch) {
+            formatRecord(out, record, log.settings, true);
+        }
+        fwrite(out.data(), 1, out.size(), log.file);
+        fflush(log.file);
+        return;
+    }
+
+    // consecutive records for the same stream go out in one write
+    std::string out;
+    FILE* current = nullptr;
+    for (const auto& record : batch) {
+        FILE* target = record.level >= Level::Warn ? stderr : stdout;
+        if (target != current && !out.empty()) {
+            fwrite(out.data(), 1, out.size(), current);
+            fflush(current);
+            out.clear();
+        }
+        current = target;
+        formatRecord(out, record, log.settings, false);
+    }
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), current);
+        fflush(current);
+    }
+}
+
+// moves everything currently buffered into batch, forgetting buffers of threads that are gone
+static void drain(Logger& log, std::vector<Record>& batch) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(log.registryMutex);
+        buffers = log.buffers;
+    }
+    std::vector<ThreadBuffer*> finished;
+    for (const auto& buffer : buffers) {
+        // read alive before draining, so a record pushed right before the thread exited isn't lost
+        bool alive = buffer->alive.load(std::memory_order_acquire);
+        Record record;
+        while (buffer->ring.pop(record)) {
+            batch.push_back(std::move(record));
+        }
+        if (!alive) {
+            finished.push_back(buffer.get());
+        }
+    }
+    if (!finished.empty()) {
+        std::lock_guard<std::mutex> lock(log.registryMutex);
+        log.buffers.erase(std::remove_if(log.buffers.begin(), log.buffers.end(), [&](const std::shared_ptr<ThreadBuffer>& buffer) {
+            return std::find(finished.begin(), finished.end(), buffer.get()) != finished.end();
+        }), log.buffers.end());
+    }
+}
+
+static void runWriter() {
+    Logger& log = logger();
+    std::vector<Record> batch;
+    while (true) {
+        uint64_t ticket = log.flushTicket.load(std::memory_order_acquire);
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(log.wakeMutex);
+            stopping = log.stopping;
+        }
+
+        batch.clear();
+        drain(log, batch);
+        if (!batch.empty()) {
+            writeBatch(log, batch);
+        }
+
+        std::unique_lock<std::mutex> lock(log.wakeMutex);
+        log.completedTicket = ticket;
+        log.flushed.notify_all();
+        if (stopping) {
+            return;
+        }
+        if (batch.empty() && log.flushTicket.load(std::memory_order_acquire) == ticket) {
+            // the timeout only covers the rare wakeup a producer misses between these two lines
+            log.writerIdle.store(true);
+            log.wake.wait_for(lock, std::chrono::milliseconds(100));
+            log.writerIdle.store(false);
+        }
+    }
+}
+
+static void ensureStarted() {
+    Logger& log = logger();
+    std::call_once(log.started, [&log]() {
+        log.writer = std::thread(runWriter);
+    });
+}
+
+static void wakeWriter(Logger& log) {
+    if (log.writerIdle.exchange(false)) {
+        log.wake.notify_one();
+    }
+}
+
+void configure(Level minLevel, Format format, const std::string& filePath) {
+    Logger& log = logger();
+    log.minLevel.store(static_cast<int>(minLevel));
+    std::lock_guard<std::mutex> lock(log.settingsMutex);
+    log.settings.minLevel = minLevel;
+    log.settings.format = format;
+    log.settings.filePath = filePath;
+}
+
+bool parseLevel(const std::string& name, Level& level) {
+    if (name == "debug") level = Level::Debug;
+    else if (name == "info") level = Level::Info;
+    else if (name == "warn" || name == "warning") level = Level::Warn;
+    else if (name == "error") level = Level::Error;
+    else return false;
+    return true;
+}
+
+bool parseFormat(const std::string& name, Format& format) {
+    if (name == "text") format = Format::Text;
+    else if (name == "json") format = Format::Json;
+    else return false;
+    return true;
+}
+
+void setRun(const std::string& runId) {
+    threadBuffer().run = runId;
+}
+
+void setStep(const std::string& stepName) {
+    threadBuffer().step = stepName;
+}
+
+bool enabled(Level level) {
+    return static_cast<int>(level) >= logger().minLevel.load(std::memory_order_relaxed);
+}
+
+void write(Level level, std::string message, bool spaced) {
+    ensureStarted();
+    Logger& log = logger();
+    ThreadBuffer& buffer = threadBuffer();
+
+    Record record;
+    record.seq = log.nextSeq.fetch_add(1, std::memory_order_relaxed);
+    record.time = std::chrono::system_clock::now();
+    record.level = level;
+    record.spaced = spaced;
+    record.thread = buffer.id;
+    record.run = buffer.run;
+    record.step = buffer.step;
+    record.message = std::move(message);
+
+    while (!buffer.ring.push(record)) {
+        // full ring: hold the thread back instead of dropping the record
+        wakeWriter(log);
+        std::this_thread::yield();
+    }
+    wakeWriter(log);
+}
+
+void flush() {
+    ensureStarted();
+    Logger& log = logger();
+    uint64_t ticket = log.flushTicket.fetch_add(1, std::memory_order_acq_rel) + 1;
+    std::unique_lock<std::mutex> lock(log.wakeMutex);
+    log.wake.notify_one();
+    log.flushed.wait(lock, [&] { return log.completedTicket >= ticket; });
+}
+
+void shutdown() {
+    Logger& log = logger();
+    {
+        std::lock_guard<std::mutex> lock(log.wakeMutex);
+        if (!log.writer.joinable()) {
+            return;
+        }
+        log.stopping = true;
+    }
+    log.wake.notify_one();
+    log.writer.join();
+    std::lock_guard<std::mutex> lock(log.settingsMutex);
+    if (log.file) {
+        fclose(log.file);
+        log.file = nullptr;
+    }
+}
+
+}
+}
@@ -0,0 +1,80 @@
+#ifndef THORFINN_LOGGER_H
+#define THORFINN_LOGGER_H
+
+#include <string>
+#include <sstream>
+
+namespace Thorfinn {
+namespace Log {
+
+enum class Level {
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+enum class Format {
+    Text,
+    Json
+};
+
+// records go into a lock-free buffer owned by the calling thread and are written out in batches by a
+// background thread, so logging never blocks on the terminal. with no file set, info and below go
+// to stdout and warnings / errors to stderr.
+void configure(Level minLevel, Format format, const std::string& filePath = "");
+bool parseLevel(const std::string& name, Level& level);
+bool parseFormat(const std::string& name, Format& format);
+
+// run / step ids attached to everything the calling thread logs, shown in json output
+void setRun(const std::string& runId);
+void setStep(const std::string& stepName);
+
+bool enabled(Level level);
+// spaced records get a blank line in front of them on the terminal, files and json keep one record per line
+void write(Level level, std::string message, bool spaced = false);
+// blocks until everything logged so far has been written, e.g. before handing the terminal to a child
+void flush();
+// flushes and stops the writer thread
+void shutdown();
+
+// collects one record with stream syntax and hands it off when the statement ends
+class Line {
+public:
+    explicit Line(Level level) : level_(level), enabled_(enabled(level)), spaced_(false) {}
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+    ~Line() {
+        if (enabled_) {
+            write(level_, stream_.str(), spaced_);
+        }
+    }
+
+    Line& spaced() {
+        spaced_ = true;
+        return *this;
+    }
+
+    template <typename T>
+    Line& operator<<(const T& value) {
+        if (enabled_) {
+            stream_ << value;
+        }
+        return *this;
+    }
+
+private:
+    Level level_;
+    bool enabled_;
+    bool spaced_;
+    std::ostringstream stream_;
+};
+
+inline Line debug() { return Line(Level::Debug); }
+inline Line info() { return Line(Level::Info); }
+inline Line warn() { return Line(Level::Warn); }
+inline Line error() { return Line(Level::Error); }
+
+}}
+
+#endif
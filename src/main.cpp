@@ -4,9 +4,15 @@
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
 #include "config.h"
 #include "pipeline.h"
 #include "file_watcher.h"
+#include "remote_file_watcher.h"
+#include "logger.h"
 
 namespace fs = std::filesystem;
 
@@ -18,6 +24,9 @@ ssh_global_config:
   port: 22
   username: "your_username"
   password: "your_password" # Warning: Insecure for production!
+log:
+  level: info # debug, info, warn, error
+  format: text # or json for one object per line with run / step ids
 triggers:
   - type: manual
     description: Execute manually via 'thorfinn exec'
@@ -47,6 +56,18 @@ void printThorfinnAscii() {
                                         ▀      ▀ )" << std::endl;
 }
 
+void applyLogConfig(const Config& config) {
+    Thorfinn::Log::Level level = Thorfinn::Log::Level::Info;
+    Thorfinn::Log::Format format = Thorfinn::Log::Format::Text;
+    if (!Thorfinn::Log::parseLevel(config.log.level, level)) {
+        Thorfinn::Log::warn() << "Warning: Unknown log level '" << config.log.level << "', using info.";
+    }
+    if (!Thorfinn::Log::parseFormat(config.log.format, format)) {
+        Thorfinn::Log::warn() << "Warning: Unknown log format '" << config.log.format << "', using text.";
+    }
+    Thorfinn::Log::configure(level, format, config.log.file);
+}
+
 void createDefaultConfig(const std::string& directory) {
     fs::path configPath = fs::path(directory) / "thorfinn.yaml";
     if (!fs::exists(configPath)) {
@@ -54,97 +75,265 @@ void createDefaultConfig(const std::string& directory) {
         if (configFile.is_open()) {
             configFile << DEFAULT_CONFIG_CONTENT;
             configFile.close();
-            std::cout << "Created default thorfinn.yaml in: " << directory << std::endl;
+            Thorfinn::Log::info() << "Created default thorfinn.yaml in: " << directory;
         } else {
-            std::cerr << "Error creating thorfinn.yaml in: " << directory << std::endl;
+            Thorfinn::Log::error() << "Error creating thorfinn.yaml in: " << directory;
         }
     } else {
-        std::cout << "thorfinn.yaml already exists in: " << directory << std::endl;
+        Thorfinn::Log::info() << "thorfinn.yaml already exists in: " << directory;
     }
 }
 
-void handleEvent(const Config& config, const std::string& workingDir) {
-    Pipeline pipeline(config, workingDir);
+// listen mode keeps the last config that parsed cleanly here. events snapshot it when they fire,
+// so a reload never pulls the config out from under a running pipeline.
+std::mutex currentConfigMutex;
+std::shared_ptr<const Config> currentConfig;
+
+std::shared_ptr<const Config> getCurrentConfig() {
+    std::lock_guard<std::mutex> lock(currentConfigMutex);
+    return currentConfig;
+}
+
+void setCurrentConfig(std::shared_ptr<const Config> config) {
+    std::lock_guard<std::mutex> lock(currentConfigMutex);
+    currentConfig = std::move(config);
+}
+
+void handleEvent(const std::string& workingDir) {
+    std::shared_ptr<const Config> config = getCurrentConfig();
+    Pipeline pipeline(*config, workingDir);
     pipeline.execute();
 }
 
-void eventLoop(const Config& config, const std::string& workingDir) {
-    std::cout << "Thorfinn is listening for events..." << std::endl;
-    for (const auto& event_trigger : config.on_event) {
-        if (event_trigger.type == "file_change") {
-            try {
-                std::string directoryToWatch = event_trigger.config.at("path");
-                if (!fs::exists(directoryToWatch)) {
-                    std::cerr << "Error: Directory not watchable" << std::endl;
-                }
+Thorfinn::FileWatcher::FileSystemChangeCallback fileEventHandler(const std::string& workingDir) {
+    return [workingDir](Thorfinn::FileWatcher::FileSystemEventType eventType, const std::string& changedPath) {
+        std::string eventTypeStr;
+        switch (eventType) {
+            case Thorfinn::FileWatcher::FileSystemEventType::Modified: eventTypeStr = "Modified"; break;
+            case Thorfinn::FileWatcher::FileSystemEventType::Created:  eventTypeStr = "Created";  break;
+            case Thorfinn::FileWatcher::FileSystemEventType::Deleted:  eventTypeStr = "Deleted";  break;
+            default: eventTypeStr = "Unknown"; break;
+        }
+        Thorfinn::Log::info() << "File system event detected: " << eventTypeStr << " - " << changedPath;
+        handleEvent(workingDir);
+    };
+}
 
-                Thorfinn::FileWatcher::watchDirectory(directoryToWatch, [&](Thorfinn::FileWatcher::FileSystemEventType eventType, const std::string& changedPath) {
-                    std::string eventTypeStr;
-                    switch (eventType) {
-                        case Thorfinn::FileWatcher::FileSystemEventType::Modified: eventTypeStr = "Modified"; break;
-                        case Thorfinn::FileWatcher::FileSystemEventType::Created:  eventTypeStr = "Created";  break;
-                        case Thorfinn::FileWatcher::FileSystemEventType::Deleted:  eventTypeStr = "Deleted";  break;
-                        default: eventTypeStr = "Unknown"; break;
-                    }
-                    std::cout << "File system event detected: " << eventTypeStr << " - " << changedPath << std::endl;
-                    handleEvent(config, workingDir);
-                });
-                std::cout << "Watching directory: " << directoryToWatch << " for changes..." << std::endl;
-            } catch (const std::out_of_range& e) {
-                std::cerr << "Error: 'path' key not found in file_change event configuration." << std::endl;
-            } catch (const fs::filesystem_error& e) {
-                std::cerr << "Filesystem error setting up watcher for " << event_trigger.config.at("path") << ": " << e.what() << std::endl;
+// fills in what a trigger inherits from the rest of the config, so a change to e.g. ssh_global_config
+// shows up as a changed trigger on reload
+EventTrigger resolveTrigger(const EventTrigger& event_trigger, const Config& config) {
+    EventTrigger resolved = event_trigger;
+    if (resolved.type == "remote_file_change") {
+        const SSHGlobalConfig& global = config.ssh_global_config;
+        resolved.config.emplace("host", global.host);
+        resolved.config.emplace("port", std::to_string(global.port));
+        resolved.config.emplace("username", global.username);
+        resolved.config.emplace("password", global.password);
+    }
+    return resolved;
+}
+
+struct ActiveTrigger {
+    EventTrigger trigger;
+    Thorfinn::FileWatcher::RunningFlag running;
+};
+
+// returns the flag that keeps the trigger alive, or nullptr if it could not be started
+Thorfinn::FileWatcher::RunningFlag startTrigger(const EventTrigger& event_trigger, const std::string& workingDir) {
+    auto running = std::make_shared<std::atomic<bool>>(true);
+    if (event_trigger.type == "file_change") {
+        try {
+            std::string directoryToWatch = event_trigger.config.at("path");
+            if (!fs::exists(directoryToWatch)) {
+                Thorfinn::Log::error() << "Error: Directory not watchable";
             }
-        } else if (event_trigger.type == "interval") {
-            try {
-                int seconds = std::stoi(event_trigger.config.at("seconds"));
-                std::thread([seconds, config, workingDir]() {
-                    while (true) {
-                        std::this_thread::sleep_for(std::chrono::seconds(seconds));
-                        std::cout << "Interval event triggered." << std::endl;
-                        handleEvent(config, workingDir);
+
+            Thorfinn::FileWatcher::watchDirectory(directoryToWatch, fileEventHandler(workingDir), running);
+            Thorfinn::Log::info() << "Watching directory: " << directoryToWatch << " for changes...";
+            return running;
+        } catch (const std::out_of_range& e) {
+            Thorfinn::Log::error() << "Error: 'path' key not found in file_change event configuration.";
+        } catch (const fs::filesystem_error& e) {
+            Thorfinn::Log::error() << "Filesystem error setting up watcher for " << event_trigger.config.at("path") << ": " << e.what();
+        }
+    } else if (event_trigger.type == "remote_file_change") {
+        try {
+            Thorfinn::RemoteFileWatcher::RemoteHost host;
+            host.host = event_trigger.config.at("host");
+            host.port = std::stoi(event_trigger.config.at("port"));
+            host.username = event_trigger.config.at("username");
+            host.password = event_trigger.config.at("password");
+            std::string directoryToWatch = event_trigger.config.at("path");
+            if (host.host.empty()) {
+                Thorfinn::Log::error() << "Error: No 'host' in remote_file_change event and no ssh_global_config host to fall back to.";
+                return nullptr;
+            }
+
+            Thorfinn::RemoteFileWatcher::watchRemoteDirectory(host, directoryToWatch, fileEventHandler(workingDir), running);
+            Thorfinn::Log::info() << "Watching remote directory: " << host.host << ":" << directoryToWatch << " for changes...";
+            return running;
+        } catch (const std::out_of_range& e) {
+            if (!event_trigger.config.count("path")) {
+                Thorfinn::Log::error() << "Error: 'path' key not found in remote_file_change event configuration.";
+            } else {
+                Thorfinn::Log::error() << "Error: 'port' value out of range in remote_file_change event.";
+            }
+        } catch (const std::invalid_argument& e) {
+            Thorfinn::Log::error() << "Error: Invalid 'port' value in remote_file_change event.";
+        }
+    } else if (event_trigger.type == "interval") {
+        try {
+            int seconds = std::stoi(event_trigger.config.at("seconds"));
+            std::thread([seconds, workingDir, running]() {
+                while (running->load()) {
+                    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+                    if (!running->load()) {
+                        break;
                     }
-                }).detach();
-                std::cout << "Interval trigger set for every " << seconds << " seconds..." << std::endl;
-            } catch (const std::invalid_argument& e) {
-                std::cerr << "Error: Invalid 'seconds' value in interval event." << std::endl;
-            } catch (const std::out_of_range& e) {
-                std::cerr << "Error: 'seconds' value out of range in interval event." << std::endl;
+                    Thorfinn::Log::info() << "Interval event triggered.";
+                    handleEvent(workingDir);
+                }
+            }).detach();
+            Thorfinn::Log::info() << "Interval trigger set for every " << seconds << " seconds...";
+            return running;
+        } catch (const std::invalid_argument& e) {
+            Thorfinn::Log::error() << "Error: Invalid 'seconds' value in interval event.";
+        } catch (const std::out_of_range& e) {
+            Thorfinn::Log::error() << "Error: 'seconds' value out of range in interval event.";
+        }
+    } else if (event_trigger.type == "webhook") {
+        Thorfinn::Log::warn() << "Warning: Webhook event handling is not yet implemented.";
+    } else {
+        Thorfinn::Log::warn() << "Warning: Unknown event type: " << event_trigger.type;
+    }
+    return nullptr;
+}
+
+// swaps in the freshly parsed config and only touches the triggers that actually changed.
+// unchanged watchers keep their thread and their last seen state, so no events get lost.
+void reloadConfig(const std::string& configPath, const std::string& workingDir, std::vector<ActiveTrigger>& active) {
+    auto started_at = std::chrono::steady_clock::now();
+
+    Config fresh;
+    if (!Config::loadFromFile(configPath, fresh)) {
+        Thorfinn::Log::error() << "Keeping previous configuration, fix " << configPath << " to apply changes.";
+        return;
+    }
+    auto next = std::make_shared<const Config>(std::move(fresh));
+    setCurrentConfig(next);
+    applyLogConfig(*next);
+
+    std::vector<EventTrigger> triggers;
+    for (const auto& event_trigger : next->on_event) {
+        triggers.push_back(resolveTrigger(event_trigger, *next));
+    }
+
+    std::vector<ActiveTrigger> updated;
+    std::vector<bool> matched(triggers.size(), false);
+    int kept = 0, stopped = 0, started = 0;
+
+    for (auto& current : active) {
+        bool found = false;
+        for (size_t i = 0; i < triggers.size(); ++i) {
+            if (!matched[i] && triggers[i].sameSourceAs(current.trigger)) {
+                matched[i] = true;
+                found = true;
+                updated.push_back({triggers[i], current.running});
+                ++kept;
+                break;
             }
-        } else if (event_trigger.type == "webhook") {
-            std::string endpoint = event_trigger.config.at("endpoint");
-            std::string method = event_trigger.config.at("method");
-            std::cerr << "Warning: Webhook event handling is not yet implemented." << std::endl;
-        } else {
-            std::cerr << "Warning: Unknown event type: " << event_trigger.type << std::endl;
+        }
+        if (!found) {
+            current.running->store(false);
+            Thorfinn::Log::info() << "Stopped " << current.trigger.type << " trigger"
+                                  << (current.trigger.description.empty() ? "" : ": " + current.trigger.description);
+            ++stopped;
+        }
+    }
+
+    for (size_t i = 0; i < triggers.size(); ++i) {
+        if (matched[i]) {
+            continue;
+        }
+        if (auto running = startTrigger(triggers[i], workingDir)) {
+            updated.push_back({triggers[i], running});
+            ++started;
         }
     }
+    active = std::move(updated);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_at);
+    Thorfinn::Log::info() << "Reloaded " << configPath << " in " << elapsed.count() / 1000.0 << " ms ("
+                          << kept << " kept, " << started << " started, " << stopped << " stopped)";
+}
+
+void eventLoop(const std::string& configPath, const std::string& workingDir) {
+    Thorfinn::Log::info() << "Thorfinn is listening for events...";
+    std::vector<ActiveTrigger> active;
+    std::shared_ptr<const Config> config = getCurrentConfig();
+    for (const auto& event_trigger : config->on_event) {
+        EventTrigger resolved = resolveTrigger(event_trigger, *config);
+        if (auto running = startTrigger(resolved, workingDir)) {
+            active.push_back({resolved, running});
+        }
+    }
+
+    std::mutex reloadMutex;
+    std::condition_variable reloadRequested;
+    bool pendingReload = false;
+
+    Thorfinn::FileWatcher::watchFile(configPath, [&](Thorfinn::FileWatcher::FileSystemEventType eventType, const std::string&) {
+        if (eventType == Thorfinn::FileWatcher::FileSystemEventType::Deleted) {
+            // editors often delete and recreate on save, keep running on the old config until it's back
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(reloadMutex);
+            pendingReload = true;
+        }
+        reloadRequested.notify_one();
+    });
+    Thorfinn::Log::info() << "Watching " << configPath << " for configuration changes...";
 
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::unique_lock<std::mutex> lock(reloadMutex);
+        reloadRequested.wait(lock, [&] { return pendingReload; });
+        pendingReload = false;
+        lock.unlock();
+
+        reloadConfig(configPath, workingDir, active);
     }
 }
 
 int main(int argc, char *argv[]) {
+    // once, before any pipeline or watcher thread exists: libssh2_init / libssh2_exit aren't thread-safe
+    if (libssh2_init(0) != 0) {
+        Thorfinn::Log::error() << "Error initializing libssh2.";
+    }
+
     if (argc == 2 && std::string(argv[1]) == "make") {
         printThorfinnAscii();
         createDefaultConfig(fs::current_path().string());
     } else if (argc >= 2 && std::string(argv[1]) == "exec") {
         std::string directory = (argc > 2) ? argv[2] : fs::current_path().string();
         Config config = Config::loadFromFile(fs::path(directory) / "thorfinn.yaml");
+        applyLogConfig(config);
         if (!config.steps.empty() || !config.triggers.empty() || !config.results.empty() || !config.name.empty() || !config.description.empty()) {
             Pipeline pipeline(config, directory);
             pipeline.execute();
         } else {
-            std::cerr << "Error: Could not load pipeline configuration from " << fs::path(directory) / "thorfinn.yaml" << std::endl;
+            Thorfinn::Log::error() << "Error: Could not load pipeline configuration from " << fs::path(directory) / "thorfinn.yaml";
         }
     } else if (argc >= 2 && std::string(argv[1]) == "listen") {
         std::string directory = (argc > 2) ? argv[2] : fs::current_path().string();
-        Config config = Config::loadFromFile(fs::path(directory) / "thorfinn.yaml");
+        std::string configPath = (fs::path(directory) / "thorfinn.yaml").string();
+        Config config = Config::loadFromFile(configPath);
+        applyLogConfig(config);
         if (!config.on_event.empty()) {
-            eventLoop(config, directory);
+            setCurrentConfig(std::make_shared<const Config>(std::move(config)));
+            eventLoop(configPath, directory);
         } else {
-            std::cout << "No 'on_event' triggers defined in thorfinn.yaml. Nothing to listen for." << std::endl;
+            Thorfinn::Log::info() << "No 'on_event' triggers defined in thorfinn.yaml. Nothing to listen for.";
         }
     } else {
         std::cout << "Usage: thorfinn <command> [directory]" << std::endl;
@@ -154,5 +343,7 @@ int main(int argc, char *argv[]) {
         std::cout << "  listen [directory]     Listens for events to trigger the pipeline (default: current)." << std::endl;
     }
 
+    libssh2_exit();
+    Thorfinn::Log::shutdown();
     return 0;
 }
\ No newline at end of file
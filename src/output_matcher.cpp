@@ -0,0 +1,431 @@
+#include "output_matcher.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <cctype>
+
+namespace Thorfinn {
+namespace OutputMatcher {
+
+// a line without a newline in sight is scanned and dropped once it gets this long
+static const size_t MAX_PENDING_LINE = 64 * 1024;
+
+// rough frequency of a byte in log output, lower is rarer
+static int byteRank(unsigned char c) {
+    static const std::string_view lowercaseByFrequency = "zqxjkvbpygfwmucldrhsnioate";
+    if (c == ' ' || c == '\t') return 40;
+    // separators that show up in nearly every timestamp, path or key=value pair
+    if (std::string_view(":-./=[],_").find(static_cast<char>(c)) != std::string_view::npos) return 30;
+    if (c >= 'a' && c <= 'z') return 10 + static_cast<int>(lowercaseByFrequency.find(static_cast<char>(c)));
+    if (c >= '0' && c <= '9') return 8;
+    if (c >= 'A' && c <= 'Z') return 5;
+    if (c < 0x80) return 3;
+    return 1;
+}
+
+static size_t rarestByte(const std::string& needle) {
+    size_t best = 0;
+    for (size_t i = 1; i < needle.size(); ++i) {
+        if (byteRank(needle[i]) <= byteRank(needle[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// every line a regex matches contains at least one of these strings. empty means nothing is known
+// and the regex has to look at every line.
+using Requirement = std::vector<std::string>;
+
+// more alternatives than this cost more passes over the output than running the regex would save
+static const size_t MAX_ALTERNATIVES = 8;
+
+// walks the ECMAScript syntax just far enough to find plain text every match must contain. anything
+// it doesn't understand makes it give up rather than guess, the regex itself is still the judge.
+class RequirementParser {
+public:
+    explicit RequirementParser(const std::string& pattern) : pattern_(pattern) {}
+
+    Requirement parse() {
+        Requirement requirement = alternation();
+        if (failed_ || pos_ != pattern_.size()) {
+            return {};
+        }
+        return requirement;
+    }
+
+private:
+    enum class AtomKind { Char, Assertion, Group, Other };
+    struct Atom {
+        AtomKind kind = AtomKind::Other;
+        char c = 0;
+        Requirement group;
+    };
+    enum class Quantifier { None, Optional, Repeated };
+
+    bool atEnd() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    // a|b|c: every branch needs something, and any one of them may be what's on the line
+    Requirement alternation() {
+        std::vector<Requirement> branches{concatenation()};
+        while (!failed_ && !atEnd() && peek() == '|') {
+            ++pos_;
+            branches.push_back(concatenation());
+        }
+        if (branches.size() == 1) {
+            return branches[0];
+        }
+        Requirement any;
+        for (const auto& branch : branches) {
+            if (branch.empty()) {
+                return {};
+            }
+            any.insert(any.end(), branch.begin(), branch.end());
+        }
+        return any.size() <= MAX_ALTERNATIVES ? any : Requirement();
+    }
+
+    // collects the plain text runs and group requirements of one branch and keeps the most selective
+    Requirement concatenation() {
+        std::vector<Requirement> found;
+        std::string run;
+        auto endRun = [&]() {
+            if (!run.empty()) {
+                found.push_back({run});
+                run.clear();
+            }
+        };
+
+        while (!failed_ && !atEnd() && peek() != '|' && peek() != ')') {
+            Atom atom = parseAtom();
+            Quantifier quantifier = parseQuantifier();
+            if (failed_) {
+                return {};
+            }
+            switch (atom.kind) {
+                case AtomKind::Char:
+                    if (quantifier == Quantifier::Optional) {
+                        // the character may be missing, which splits the text around it
+                        endRun();
+                    } else {
+                        run += atom.c;
+                        if (quantifier == Quantifier::Repeated) {
+                            endRun();
+                        }
+                    }
+                    break;
+                case AtomKind::Group:
+                    endRun();
+                    if (quantifier != Quantifier::Optional && !atom.group.empty()) {
+                        found.push_back(atom.group);
+                    }
+                    break;
+                case AtomKind::Assertion:
+                case AtomKind::Other:
+                    endRun();
+                    break;
+            }
+        }
+        endRun();
+
+        // the best requirement is the one whose shortest string is longest, fewer alternatives break ties
+        Requirement best;
+        size_t bestLength = 0;
+        for (const auto& requirement : found) {
+            size_t shortest = std::min_element(requirement.begin(), requirement.end(), [](const std::string& a, const std::string& b) {
+                return a.size() < b.size();
+            })->size();
+            if (shortest > bestLength || (shortest == bestLength && requirement.size() < best.size())) {
+                best = requirement;
+                bestLength = shortest;
+            }
+        }
+        return best;
+    }
+
+    Atom parseAtom() {
+        Atom atom;
+        char c = pattern_[pos_++];
+        switch (c) {
+            case '^':
+            case '$':
+                atom.kind = AtomKind::Assertion;
+                return atom;
+            case '.':
+                return atom;
+            case '[':
+                skipClass();
+                return atom;
+            case '(':
+                return parseGroup();
+            case '\\':
+                return parseEscape();
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+            case '}':
+            case ']':
+                failed_ = true;
+                return atom;
+            default:
+                atom.kind = AtomKind::Char;
+                atom.c = c;
+                return atom;
+        }
+    }
+
+    Atom parseGroup() {
+        Atom atom;
+        bool lookaround = false;
+        if (!atEnd() && peek() == '?') {
+            if (pos_ + 1 >= pattern_.size()) {
+                failed_ = true;
+                return atom;
+            }
+            char kind = pattern_[pos_ + 1];
+            if (kind == '=' || kind == '!') {
+                lookaround = true;
+            } else if (kind != ':') {
+                failed_ = true;
+                return atom;
+            }
+            pos_ += 2;
+        }
+        Requirement inner = alternation();
+        if (failed_ || atEnd() || peek() != ')') {
+            failed_ = true;
+            return atom;
+        }
+        ++pos_;
+        if (!lookaround) {
+            atom.kind = AtomKind::Group;
+            atom.group = inner;
+        }
+        return atom;
+    }
+
+    Atom parseEscape() {
+        Atom atom;
+        if (atEnd()) {
+            failed_ = true;
+            return atom;
+        }
+        char e = pattern_[pos_++];
+        switch (e) {
+            case 'b':
+            case 'B':
+                atom.kind = AtomKind::Assertion;
+                return atom;
+            case 'n': atom.kind = AtomKind::Char; atom.c = '\n'; return atom;
+            case 't': atom.kind = AtomKind::Char; atom.c = '\t'; return atom;
+            case 'r': atom.kind = AtomKind::Char; atom.c = '\r'; return atom;
+            case 'f': atom.kind = AtomKind::Char; atom.c = '\f'; return atom;
+            case 'v': atom.kind = AtomKind::Char; atom.c = '\v'; return atom;
+            case 'x': pos_ += 2; return atom;
+            case 'u': pos_ += 4; return atom;
+            case 'c': pos_ += 1; return atom;
+            default:
+                if (std::isalnum(static_cast<unsigned char>(e))) {
+                    // classes like \d \w \s and backreferences
+                    return atom;
+                }
+                atom.kind = AtomKind::Char;
+                atom.c = e;
+                return atom;
+        }
+    }
+
+    void skipClass() {
+        if (!atEnd() && peek() == '^') {
+            ++pos_;
+        }
+        while (!atEnd() && peek() != ']') {
+            pos_ += peek() == '\\' ? 2 : 1;
+        }
+        if (atEnd()) {
+            failed_ = true;
+            return;
+        }
+        ++pos_;
+    }
+
+    Quantifier parseQuantifier() {
+        if (atEnd()) {
+            return Quantifier::None;
+        }
+        Quantifier quantifier = Quantifier::None;
+        char c = peek();
+        if (c == '*' || c == '?') {
+            quantifier = Quantifier::Optional;
+            ++pos_;
+        } else if (c == '+') {
+            quantifier = Quantifier::Repeated;
+            ++pos_;
+        } else if (c == '{') {
+            size_t close = pattern_.find('}', pos_);
+            if (close == std::string::npos || close == pos_ + 1 || !std::isdigit(static_cast<unsigned char>(pattern_[pos_ + 1]))) {
+                failed_ = true;
+                return quantifier;
+            }
+            // only whether the minimum is zero matters, so the digits are never converted and
+            // counts of any length are fine
+            bool zeroMinimum = true;
+            size_t i = pos_ + 1;
+            for (; i < close && std::isdigit(static_cast<unsigned char>(pattern_[i])); ++i) {
+                zeroMinimum = zeroMinimum && pattern_[i] == '0';
+            }
+            if (i != close && pattern_[i] != ',') {
+                failed_ = true;
+                return quantifier;
+            }
+            quantifier = zeroMinimum ? Quantifier::Optional : Quantifier::Repeated;
+            pos_ = close + 1;
+        } else {
+            return quantifier;
+        }
+        // lazy quantifiers match the same text
+        if (!atEnd() && peek() == '?') {
+            ++pos_;
+        }
+        return quantifier;
+    }
+
+    const std::string& pattern_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+};
+
+static const char* findLiteral(const char* pos, const char* end, const std::string& needle, size_t rareIndex) {
+    // memchr is the vectorized primitive here, anchoring on a rare byte keeps false candidates low
+    const char* anchor = pos + rareIndex;
+    const char rare = needle[rareIndex];
+    while (anchor < end) {
+        anchor = static_cast<const char*>(memchr(anchor, rare, end - anchor));
+        if (!anchor) {
+            return nullptr;
+        }
+        const char* start = anchor - rareIndex;
+        if (static_cast<size_t>(end - start) >= needle.size() && memcmp(start, needle.data(), needle.size()) == 0) {
+            return start;
+        }
+        ++anchor;
+    }
+    return nullptr;
+}
+
+Scanner::Scanner(const std::vector<OutputRule>& rules, MatchCallback onMatch) : rules_(rules), onMatch_(std::move(onMatch)) {
+    for (size_t i = 0; i < rules_.size(); ++i) {
+        if (rules_[i].regex) {
+            if (!rules_[i].compiled) {
+                continue;
+            }
+            Requirement requirement = RequirementParser(rules_[i].pattern).parse();
+            if (requirement.empty()) {
+                regexRules_.push_back(i);
+            }
+            for (const auto& literal : requirement) {
+                literals_.push_back({i, literal, rarestByte(literal), true});
+            }
+        } else if (!rules_[i].pattern.empty()) {
+            literals_.push_back({i, rules_[i].pattern, rarestByte(rules_[i].pattern), false});
+        }
+    }
+}
+
+void Scanner::feed(const char* data, size_t size) {
+    std::string_view chunk(data, size);
+    size_t lastNewline = chunk.rfind('\n');
+    if (lastNewline == std::string_view::npos) {
+        pending_.append(data, size);
+        if (pending_.size() > MAX_PENDING_LINE) {
+            scanLines(pending_.data(), pending_.data() + pending_.size());
+            pending_.clear();
+        }
+        return;
+    }
+
+    const char* cursor = data;
+    if (!pending_.empty()) {
+        // only the line straddling the boundary gets copied, the rest is scanned in place
+        size_t firstNewline = chunk.find('\n');
+        pending_.append(data, firstNewline);
+        scanLines(pending_.data(), pending_.data() + pending_.size());
+        pending_.clear();
+        cursor = data + firstNewline + 1;
+    }
+    if (cursor < data + lastNewline) {
+        scanLines(cursor, data + lastNewline);
+    }
+    pending_.assign(data + lastNewline + 1, size - lastNewline - 1);
+}
+
+void Scanner::finish() {
+    if (!pending_.empty()) {
+        scanLines(pending_.data(), pending_.data() + pending_.size());
+        pending_.clear();
+    }
+}
+
+// [begin, end) holds complete lines separated by '\n'
+void Scanner::scanLines(const char* begin, const char* end) {
+    hits_.clear();
+
+    // literals jump straight to candidate positions over the whole region. lines are only located
+    // around actual hits, so noisy output that matches nothing never gets split into lines at all.
+    for (const auto& literal : literals_) {
+        const char* pos = begin;
+        while (pos < end) {
+            const char* hit = findLiteral(pos, end, literal.needle, literal.rareIndex);
+            if (!hit) {
+                break;
+            }
+            size_t lineOffset = std::string_view(begin, hit - begin).rfind('\n');
+            const char* lineStart = lineOffset == std::string_view::npos ? begin : begin + lineOffset + 1;
+            const char* lineEnd = static_cast<const char*>(memchr(hit, '\n', end - hit));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            hits_.push_back({lineStart, lineEnd, literal.rule, literal.verifyRegex});
+            pos = lineEnd + 1;
+        }
+    }
+
+    if (!regexRules_.empty()) {
+        const char* lineStart = begin;
+        while (lineStart <= end) {
+            const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', end - lineStart));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            for (size_t rule : regexRules_) {
+                if (std::regex_search(lineStart, lineEnd, *rules_[rule].compiled)) {
+                    hits_.push_back({lineStart, lineEnd, rule, false});
+                }
+            }
+            lineStart = lineEnd + 1;
+        }
+    }
+
+    if (hits_.empty()) {
+        return;
+    }
+    // fire in the order the lines appeared, and in config order within a line
+    std::sort(hits_.begin(), hits_.end(), [](const Hit& a, const Hit& b) {
+        return a.lineStart != b.lineStart ? a.lineStart < b.lineStart : a.rule < b.rule;
+    });
+    // alternatives of one rule can all show up on the same line, it still fires once
+    hits_.erase(std::unique(hits_.begin(), hits_.end(), [](const Hit& a, const Hit& b) {
+        return a.lineStart == b.lineStart && a.rule == b.rule;
+    }), hits_.end());
+    for (const auto& hit : hits_) {
+        if (hit.verifyRegex && !std::regex_search(hit.lineStart, hit.lineEnd, *rules_[hit.rule].compiled)) {
+            continue;
+        }
+        onMatch_(rules_[hit.rule], std::string(hit.lineStart, hit.lineEnd));
+    }
+}
+
+}
+}
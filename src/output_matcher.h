@@ -0,0 +1,54 @@
+#ifndef THORFINN_OUTPUT_MATCHER_H
+#define THORFINN_OUTPUT_MATCHER_H
+
+#include "config.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace Thorfinn {
+namespace OutputMatcher {
+
+using MatchCallback = std::function<void(const OutputRule&, const std::string& line)>;
+
+// matches on_output rules against a stream chunk by chunk. rules are evaluated per line and fire at
+// most once per line. only the unfinished last line of a chunk is kept around, so a match can span
+// chunk boundaries without the step's output ever being buffered as a whole.
+class Scanner {
+public:
+    Scanner(const std::vector<OutputRule>& rules, MatchCallback onMatch);
+    void feed(const char* data, size_t size);
+    // flushes a trailing line that wasn't terminated by a newline
+    void finish();
+
+private:
+    struct Hit {
+        const char* lineStart;
+        const char* lineEnd;
+        size_t rule;
+        bool verifyRegex; // only a literal of the rule was found, the regex still has to confirm
+    };
+
+    // a literal every match has to contain. regex rules get one extracted from the pattern when
+    // possible, or one per branch of an alternation, so only lines containing them reach the regex engine.
+    struct Literal {
+        size_t rule;
+        std::string needle;
+        size_t rareIndex; // position of the byte least likely to show up in output, used as memchr anchor
+        bool verifyRegex;
+    };
+
+    void scanLines(const char* begin, const char* end);
+
+    const std::vector<OutputRule>& rules_;
+    MatchCallback onMatch_;
+    std::vector<Literal> literals_;
+    std::vector<size_t> regexRules_; // regexes without a usable literal, checked on every line
+    std::string pending_;
+    std::vector<Hit> hits_;
+};
+
+}}
+
+#endif
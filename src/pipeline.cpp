@@ -1,5 +1,7 @@
 #include "pipeline.h"
-#include <iostream>
+#include "workspace.h"
+#include "output_matcher.h"
+#include "logger.h"
 #include <sstream>
 #include <stdexcept>
 #include <sys/wait.h>
@@ -7,25 +9,26 @@
 #include <vector>
 #include <functional>
 #include <cstring>
+#include <cerrno>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <signal.h>
+#include <atomic>
+#include <ctime>
 #include <netinet/in.h>
 
 Pipeline::Pipeline(const Config& config, const std::string& workingDir) : config_(config), workingDir_(workingDir), sshSession(nullptr), sshChannel(nullptr) {
-    if (libssh2_init(0) != 0) {
-        std::cerr << "Error initializing libssh2." << std::endl;
-    }
     if (!config_.ssh_global_config.host.empty()) {
-        std::cout << "Attempting global SSH connection..." << std::endl;
+        Thorfinn::Log::info() << "Attempting global SSH connection...";
         establishSSHConnection(config_.ssh_global_config);
     }
 }
 
 Pipeline::~Pipeline() {
     closeSSHConnection();
-    libssh2_exit();
 }
 
 
@@ -34,7 +37,7 @@ bool Pipeline::establishSSHConnection(const std::string& host, int port, const s
 
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
-        perror("socket");
+        Thorfinn::Log::error() << "socket: " << strerror(errno);
         return false;
     }
 
@@ -46,7 +49,7 @@ bool Pipeline::establishSSHConnection(const std::string& host, int port, const s
     if (sin.sin_addr.s_addr == INADDR_NONE) {
         struct hostent* hp = gethostbyname(host.c_str());
         if (hp == nullptr) {
-            std::cerr << "Error: Could not resolve hostname: " << host << std::endl;
+            Thorfinn::Log::error() << "Error: Could not resolve hostname: " << host;
             close(sock);
             return false;
         }
@@ -54,14 +57,14 @@ bool Pipeline::establishSSHConnection(const std::string& host, int port, const s
     }
 
     if (connect(sock, (struct sockaddr*)&sin, sizeof(struct sockaddr_in)) != 0) {
-        perror("connect");
+        Thorfinn::Log::error() << "connect: " << strerror(errno);
         close(sock);
         return false;
     }
 
     sshSession = libssh2_session_init();
     if (!sshSession) {
-        std::cerr << "Error initializing SSH session." << std::endl;
+        Thorfinn::Log::error() << "Error initializing SSH session.";
         close(sock);
         return false;
     }
@@ -70,7 +73,7 @@ bool Pipeline::establishSSHConnection(const std::string& host, int port, const s
         char* err_msg;
         int err_code;
         libssh2_session_last_error(sshSession, &err_msg, &err_code, 0);
-        std::cerr << "Error during SSH handshake: " << err_msg << " (" << err_code << ")" << std::endl;
+        Thorfinn::Log::error() << "Error during SSH handshake: " << err_msg << " (" << err_code << ")";
         closeSSHConnection();
         close(sock);
         return false;
@@ -80,13 +83,13 @@ bool Pipeline::establishSSHConnection(const std::string& host, int port, const s
         char* err_msg;
         int err_code;
         libssh2_session_last_error(sshSession, &err_msg, &err_code, 0);
-        std::cerr << "Error during SSH password authentication: " << err_msg << " (" << err_code << ")" << std::endl;
+        Thorfinn::Log::error() << "Error during SSH password authentication: " << err_msg << " (" << err_code << ")";
         closeSSHConnection();
         close(sock);
         return false;
     }
 
-    std::cout << "SSH connection established to " << host << ":" << port << " as user " << username << std::endl;
+    Thorfinn::Log::info() << "SSH connection established to " << host << ":" << port << " as user " << username;
     return true;
 }
 
@@ -101,14 +104,14 @@ bool Pipeline::establishSSHConnection(const std::map<std::string, std::string>&
             try {
                 port = std::stoi(sshConfig.at("port"));
             } catch (const std::invalid_argument& e) {
-                std::cerr << "Warning: Invalid SSH port specified: " << sshConfig.at("port") << ". Using default port 22." << std::endl;
+                Thorfinn::Log::warn() << "Warning: Invalid SSH port specified: " << sshConfig.at("port") << ". Using default port 22.";
             } catch (const std::out_of_range& e) {
-                std::cerr << "Warning: SSH port out of range: " << sshConfig.at("port") << ". Using default port 22." << std::endl;
+                Thorfinn::Log::warn() << "Warning: SSH port out of range: " << sshConfig.at("port") << ". Using default port 22.";
             }
         }
         return establishSSHConnection(sshConfig.at("host"), port, sshConfig.at("username"), sshConfig.at("password"));
     } else {
-        std::cerr << "Warning: Incomplete SSH configuration provided for step." << std::endl;
+        Thorfinn::Log::warn() << "Warning: Incomplete SSH configuration provided for step.";
         return false;
     }
 }
@@ -124,7 +127,7 @@ void Pipeline::closeSSHConnection() {
         libssh2_session_free(sshSession);
         // socket gone?
         sshSession = nullptr;
-        std::cout << "SSH connection closed." << std::endl;
+        Thorfinn::Log::info() << "SSH connection closed.";
     }
 }
 
@@ -133,31 +136,89 @@ LIBSSH2_SESSION* Pipeline::getSSHSession() const {
 }
 
 bool Pipeline::execute() {
-    std::cout << "Executing pipeline: " << config_.name << " in " << workingDir_ << std::endl;
+    static std::atomic<unsigned> runCounter{0};
+    Thorfinn::Log::setRun(std::to_string(time(nullptr)) + "-" + std::to_string(runCounter++));
+    Thorfinn::Log::info() << "Executing pipeline: " << config_.name << " in " << workingDir_;
 
+    bool success = true;
     for (const auto& step : config_.steps) {
-        std::cout << "\n--- Executing step: " << step.name << " ---" << std::endl;
+        Thorfinn::Log::setStep(step.name);
+        Thorfinn::Log::info().spaced() << "--- Executing step: " << step.name << " ---";
         if (!executeStep(step)) {
-            std::cerr << "Step '" << step.name << "' failed." << std::endl;
-            return false;
+            Thorfinn::Log::error() << "Step '" << step.name << "' failed.";
+            success = false;
+            break;
         }
     }
+    Thorfinn::Log::setStep("");
+
+    if (success) {
+        Thorfinn::Log::info().spaced() << "--- Pipeline execution finished ---";
+    }
+    Thorfinn::Log::setRun("");
+    return success;
+}
 
-    std::cout << "\n--- Pipeline execution finished ---" << std::endl;
+// close-on-exec, otherwise a step forked by another pipeline thread inherits the write ends and
+// we never see EOF. dup2 in our own child clears the flag on stdout / stderr.
+static bool openCloexecPipe(int fds[2]) {
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
     return true;
+#endif
 }
 
 bool Pipeline::executeStep(const Step& step) {
 
     if (step.run.empty()) {
-        std::cerr << "Warning: 'run' command not defined for step '" << step.name << "'." << std::endl;
+        Thorfinn::Log::warn() << "Warning: 'run' command not defined for step '" << step.name << "'.";
         return true;
     }
 
+    std::string stepDir = workingDir_;
+    Thorfinn::Workspace::IsolatedWorkspace workspace;
+    if (step.isolated) {
+        if (!Thorfinn::Workspace::create(workingDir_, step.name, step.outputs, workspace)) {
+            handleStepActions(step.on_failure, step.name, "");
+            return false;
+        }
+        stepDir = workspace.root;
+    }
+
+    // output only gets piped through us when there's something to match, otherwise the child writes straight to the terminal
+    int outPipe[2] = {-1, -1};
+    int errPipe[2] = {-1, -1};
+    bool matchOutput = !step.on_output.empty();
+    if (matchOutput && (!openCloexecPipe(outPipe) || !openCloexecPipe(errPipe))) {
+        Thorfinn::Log::error() << "pipe: " << strerror(errno);
+        Thorfinn::Log::warn() << "Warning: on_output rules of step '" << step.name << "' are disabled for this run.";
+        for (int fd : {outPipe[0], outPipe[1], errPipe[0], errPipe[1]}) {
+            if (fd >= 0) close(fd);
+        }
+        matchOutput = false;
+    }
+
+    // the child writes to the terminal directly, get our own lines out before it does
+    Thorfinn::Log::flush();
     pid_t pid = fork();
     if (pid == -1) {
+        Thorfinn::Workspace::remove(workspace);
         throw std::runtime_error("fork failed");
     } else if (pid == 0) {
+        if (matchOutput) {
+            dup2(outPipe[1], STDOUT_FILENO);
+            dup2(errPipe[1], STDERR_FILENO);
+            for (int fd : {outPipe[0], outPipe[1], errPipe[0], errPipe[1]}) {
+                close(fd);
+            }
+        }
+
         std::stringstream ss(step.run);
         std::string segment;
         std::vector<char*> args;
@@ -166,7 +227,7 @@ bool Pipeline::executeStep(const Step& step) {
         }
         args.push_back(nullptr);
 
-        if (!workingDir_.empty() && chdir(workingDir_.c_str()) != 0) {
+        if (!stepDir.empty() && chdir(stepDir.c_str()) != 0) {
             perror("chdir");
             exit(EXIT_FAILURE);
         }
@@ -175,41 +236,129 @@ bool Pipeline::executeStep(const Step& step) {
         perror("execvp");
         exit(EXIT_FAILURE);
     } else { // Parent process
+        bool aborted = false;
+        if (matchOutput) {
+            close(outPipe[1]);
+            close(errPipe[1]);
+            aborted = streamStepOutput(step, pid, outPipe[0], errPipe[0]);
+            close(outPipe[0]);
+            close(errPipe[0]);
+        }
+
         int status;
         waitpid(pid, &status, 0);
         bool success = false;
+        // checked whatever the outcome, a failing step may have written through just the same
+        bool linkedIntact = !step.isolated || Thorfinn::Workspace::checkLinkedFiles(workspace);
 
-        if (WIFEXITED(status)) {
+        if (aborted) {
+            Thorfinn::Log::error() << "Step '" << step.name << "' aborted by on_output rule.";
+            handleStepActions(step.on_failure, step.name, "");
+        } else if (WIFEXITED(status)) {
             int exitStatus = WEXITSTATUS(status);
-            if (exitStatus == 0) {
-                std::cout << "Step '" << step.name << "' completed successfully." << std::endl;
+            if (exitStatus == 0 && !linkedIntact) {
+                Thorfinn::Log::error() << "Step '" << step.name << "' wrote to files shared with " << workingDir_ << ".";
+                handleStepActions(step.on_failure, step.name, "");
+            } else if (exitStatus == 0 && step.isolated && !Thorfinn::Workspace::mergeOutputs(workspace)) {
+                Thorfinn::Log::error() << "Step '" << step.name << "' could not merge its outputs back.";
+                handleStepActions(step.on_failure, step.name, "");
+            } else if (exitStatus == 0) {
+                Thorfinn::Log::info() << "Step '" << step.name << "' completed successfully.";
                 handleStepActions(step.on_success, step.name, "");
                 success = true;
             } else {
-                std::cerr << "Step '" << step.name << "' failed with exit code: " << exitStatus << std::endl;
+                Thorfinn::Log::error() << "Step '" << step.name << "' failed with exit code: " << exitStatus;
                 handleStepActions(step.on_failure, step.name, "");
             }
         } else if (WIFSIGNALED(status)) {
-            std::cerr << "Step '" << step.name << "' terminated by signal: " << WTERMSIG(status) << std::endl;
+            Thorfinn::Log::error() << "Step '" << step.name << "' terminated by signal: " << WTERMSIG(status);
         } else {
-            std::cerr << "Step '" << step.name << "' had an unexpected termination." << std::endl;
+            Thorfinn::Log::error() << "Step '" << step.name << "' had an unexpected termination.";
         }
 
+        Thorfinn::Workspace::remove(workspace);
+
         return success;
     }
 }
 
+// tees the child's output to our own stdout / stderr while running it through the on_output rules.
+// returns true if a rule aborted the step.
+bool Pipeline::streamStepOutput(const Step& step, pid_t pid, int stdoutFd, int stderrFd) {
+    bool aborted = false;
+    auto onMatch = [&](const OutputRule& rule, const std::string& line) {
+        if (aborted) {
+            return;
+        }
+        Thorfinn::Log::info() << "  [" << step.name << "] Output matched '" << rule.pattern << "': " << line;
+        handleStepActions(rule.actions, step.name, line);
+        if (rule.abort) {
+            kill(pid, SIGTERM);
+            aborted = true;
+        }
+    };
+    // separate scanners so interleaved stdout / stderr writes never get glued into one line
+    Thorfinn::OutputMatcher::Scanner outScanner(step.on_output, onMatch);
+    Thorfinn::OutputMatcher::Scanner errScanner(step.on_output, onMatch);
+
+    struct pollfd fds[2] = {{stdoutFd, POLLIN, 0}, {stderrFd, POLLIN, 0}};
+    Thorfinn::OutputMatcher::Scanner* scanners[2] = {&outScanner, &errScanner};
+    int targets[2] = {STDOUT_FILENO, STDERR_FILENO};
+    int open_fds = 2;
+    char buffer[0x10000];
+
+    // once aborted stop draining, grandchildren may keep the pipes open long after the step itself is gone
+    while (open_fds > 0 && !aborted) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Thorfinn::Log::error() << "poll: " << strerror(errno);
+            break;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            ssize_t nbytes = read(fds[i].fd, buffer, sizeof(buffer));
+            if (nbytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (nbytes <= 0) {
+                scanners[i]->finish();
+                fds[i].fd = -1;
+                --open_fds;
+                continue;
+            }
+            for (ssize_t written = 0; written < nbytes;) {
+                ssize_t n = write(targets[i], buffer + written, nbytes - written);
+                if (n <= 0) {
+                    break;
+                }
+                written += n;
+            }
+            scanners[i]->feed(buffer, nbytes);
+        }
+    }
+    return aborted;
+}
+
 void Pipeline::handleStepActions(const std::vector<std::map<std::string, std::string>>& actions, const std::string& stepName, const std::string& output) {
     for (const auto& action : actions) {
         if (action.count("log")) {
-            std::cout << "  [" << stepName << "] Log: " << action.at("log") << std::endl;
+            Thorfinn::Log::info() << "  [" << stepName << "] Log: " << action.at("log");
         } else if (action.count("bash")) {
             std::string bashCommand = action.at("bash");
-            std::cout << "  [" << stepName << "] Executing bash action: " << bashCommand << std::endl;
+            Thorfinn::Log::info() << "  [" << stepName << "] Executing bash action: " << bashCommand;
+            Thorfinn::Log::flush();
             pid_t pid = fork();
             if (pid == -1) {
-                perror("fork");
+                Thorfinn::Log::error() << "fork: " << strerror(errno);
             } else if (pid == 0) {
+                // actions fired by on_output get the line that matched
+                if (!output.empty()) {
+                    setenv("THORFINN_OUTPUT", output.c_str(), 1);
+                }
                 execl("/bin/bash", "bash", "-c", bashCommand.c_str(), nullptr);
                 perror("execl");
                 exit(EXIT_FAILURE);
@@ -217,31 +366,33 @@ void Pipeline::handleStepActions(const std::vector<std::map<std::string, std::st
                 int status;
                 waitpid(pid, &status, 0);
                 if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                    std::cerr << "  [" << stepName << "] Bash action failed with exit code: " << WEXITSTATUS(status) << std::endl;
+                    Thorfinn::Log::error() << "  [" << stepName << "] Bash action failed with exit code: " << WEXITSTATUS(status);
                 }
             }
         } else if (action.count("file_output")) {
-            std::cout << "  [" << stepName << "] File output: " << action.at("file_output") << std::endl;
+            Thorfinn::Log::info() << "  [" << stepName << "] File output: " << action.at("file_output");
         } else if (action.count("notify")) {
-            std::cout << "  [" << stepName << "] Notification: " << action.at("notify") << std::endl;
+            Thorfinn::Log::info() << "  [" << stepName << "] Notification: " << action.at("notify");
         } else if (action.count("ssh_command")) {
             if (sshSession) {
                 std::string sshCommand = action.at("ssh_command");
-                std::cout << "  [" << stepName << "] Executing SSH command: " << sshCommand << std::endl;
+                Thorfinn::Log::info() << "  [" << stepName << "] Executing SSH command: " << sshCommand;
                 LIBSSH2_CHANNEL* channel = libssh2_channel_open_session(sshSession);
                 if (channel) {
                     if (libssh2_channel_exec(channel, sshCommand.c_str()) == 0) {
                         // thanks mr. stackoverflow & libssh docs
                         char buffer[0x4000];
                         ssize_t nbytes;
+                        Thorfinn::Log::flush();
                         while ((nbytes = libssh2_channel_read(channel, buffer, sizeof(buffer))) > 0) {
                             fwrite(buffer, 1, nbytes, stdout);
                         }
+                        fflush(stdout);
                         int exitcode = 0;
                         if (libssh2_channel_close(channel) == 0) {
                             exitcode = libssh2_channel_get_exit_status(channel);
                             if (exitcode != 0) {
-                                std::cerr << "  [" << stepName << "] SSH command exited with code: " << exitcode << std::endl;
+                                Thorfinn::Log::error() << "  [" << stepName << "] SSH command exited with code: " << exitcode;
                             }
                         }
                         libssh2_channel_free(channel);
@@ -249,29 +400,29 @@ void Pipeline::handleStepActions(const std::vector<std::map<std::string, std::st
                         char* err_msg;
                         int err_code;
                         libssh2_session_last_error(sshSession, &err_msg, &err_code, 0);
-                        std::cerr << "  [" << stepName << "] Error executing SSH command: " << err_msg << " (" << err_code << ")" << std::endl;
+                        Thorfinn::Log::error() << "  [" << stepName << "] Error executing SSH command: " << err_msg << " (" << err_code << ")";
                     }
                 } else {
-                    std::cerr << "  [" << stepName << "] Error opening SSH channel." << std::endl;
+                    Thorfinn::Log::error() << "  [" << stepName << "] Error opening SSH channel.";
                 }
             } else {
-                std::cerr << "  [" << stepName << "] SSH session not established. Cannot execute ssh_command." << std::endl;
+                Thorfinn::Log::error() << "  [" << stepName << "] SSH session not established. Cannot execute ssh_command.";
             }
         } else if (action.count("deploy_files")) {
             if (sshSession) {
                 std::string remote_path = action.at("deploy_files");
-                std::cout << "  [" << stepName << "] Preparing to deploy files to: " << remote_path << std::endl;
+                Thorfinn::Log::info() << "  [" << stepName << "] Preparing to deploy files to: " << remote_path;
                 // todo: implement libssh2_scp_send
-                std::cerr << "  [" << stepName << "] Warning: 'deploy_files' action is not yet implemented." << std::endl;
+                Thorfinn::Log::warn() << "  [" << stepName << "] Warning: 'deploy_files' action is not yet implemented.";
             } else {
-                std::cerr << "  [" << stepName << "] SSH session not established. Cannot deploy files." << std::endl;
+                Thorfinn::Log::error() << "  [" << stepName << "] SSH session not established. Cannot deploy files.";
             }
         }
          else if (action.count("establish_ssh")) {
             establishSSHConnection(action);
         }
         else {
-            std::cout << "  [" << stepName << "] Unknown action." << std::endl;
+            Thorfinn::Log::info() << "  [" << stepName << "] Unknown action.";
         }
     }
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <libssh2.h>
 #include <functional>
 #include <string>
+#include <sys/types.h>
 
 class Pipeline {
 public:
@@ -21,6 +22,7 @@ private:
     LIBSSH2_SESSION* sshSession;
     LIBSSH2_CHANNEL* sshChannel;
     bool executeStep(const Step& step);
+    bool streamStepOutput(const Step& step, pid_t pid, int stdoutFd, int stderrFd);
     void handleStepActions(const std::vector<std::map<std::string, std::string>>& actions, const std::string& stepName, const std::string& output);
     bool establishSSHConnection(const SSHGlobalConfig& sshConfig);
     bool establishSSHConnection(const std::map<std::string, std::string>& sshConfig);
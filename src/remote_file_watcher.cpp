@@ -0,0 +1,328 @@
+#include "remote_file_watcher.h"
+#include "logger.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <libssh2.h>
+#include <libssh2_sftp.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Thorfinn {
+namespace RemoteFileWatcher {
+
+struct RemoteFileState {
+    libssh2_uint64_t size;
+    unsigned long mtime;
+
+    bool operator!=(const RemoteFileState& other) const { return size != other.size || mtime != other.mtime; }
+};
+
+struct RemoteWatch {
+    std::string directoryPath;
+    FileWatcher::FileSystemChangeCallback callback;
+    FileWatcher::RunningFlag running;
+    std::map<std::string, RemoteFileState> last_state;
+    bool primed = false;
+    bool failing = false;
+};
+
+struct PendingEvent {
+    std::shared_ptr<RemoteWatch> watch;
+    FileWatcher::FileSystemEventType type;
+    std::string path;
+};
+
+struct HostWatcher {
+    RemoteHost host;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<RemoteWatch>> watches;
+
+    // callbacks run pipelines, so they go to their own thread and the poll loop keeps the
+    // session busy with the other directories in the meantime
+    std::mutex eventsMutex;
+    std::condition_variable eventsReady;
+    std::deque<PendingEvent> events;
+    bool polling = true;
+};
+
+struct SftpConnection {
+    int sock = -1;
+    LIBSSH2_SESSION* session = nullptr;
+    LIBSSH2_SFTP* sftp = nullptr;
+};
+
+static std::mutex hostsMutex;
+static std::map<std::string, std::shared_ptr<HostWatcher>> hosts;
+
+// credentials are part of the key: a watch with a changed password gets its own session instead of
+// joining one that keeps reconnecting with the old one. the old session goes away with its last watch.
+static std::string hostKey(const RemoteHost& host) {
+    return host.username + ":" + host.password + "@" + host.host + ":" + std::to_string(host.port);
+}
+
+static bool isRunning(const FileWatcher::RunningFlag& running) {
+    return !running || running->load();
+}
+
+static void disconnect(SftpConnection& conn) {
+    if (conn.sftp) {
+        libssh2_sftp_shutdown(conn.sftp);
+        conn.sftp = nullptr;
+    }
+    if (conn.session) {
+        libssh2_session_disconnect(conn.session, "Closing session");
+        libssh2_session_free(conn.session);
+        conn.session = nullptr;
+    }
+    if (conn.sock >= 0) {
+        close(conn.sock);
+        conn.sock = -1;
+    }
+}
+
+static bool connect(const RemoteHost& host, SftpConnection& conn) {
+    // getaddrinfo instead of gethostbyname, this runs on a background thread
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.host.c_str(), std::to_string(host.port).c_str(), &hints, &addresses) != 0) {
+        Log::error() << "Error: Could not resolve hostname: " << host.host;
+        return false;
+    }
+    for (struct addrinfo* addr = addresses; addr != nullptr; addr = addr->ai_next) {
+        conn.sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (conn.sock < 0) {
+            continue;
+        }
+        if (::connect(conn.sock, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+        close(conn.sock);
+        conn.sock = -1;
+    }
+    freeaddrinfo(addresses);
+    if (conn.sock < 0) {
+        Log::error() << "Error: Could not connect to " << host.host << ":" << host.port;
+        return false;
+    }
+
+    conn.session = libssh2_session_init();
+    if (!conn.session) {
+        Log::error() << "Error initializing SSH session.";
+        disconnect(conn);
+        return false;
+    }
+    // don't let a hung host stall the watcher forever
+    libssh2_session_set_timeout(conn.session, 10000);
+
+    char* err_msg;
+    int err_code;
+    if (libssh2_session_handshake(conn.session, conn.sock) != LIBSSH2_ERROR_NONE) {
+        libssh2_session_last_error(conn.session, &err_msg, &err_code, 0);
+        Log::error() << "Error during SSH handshake with " << host.host << ": " << err_msg << " (" << err_code << ")";
+        disconnect(conn);
+        return false;
+    }
+    if (libssh2_userauth_password(conn.session, host.username.c_str(), host.password.c_str()) != LIBSSH2_ERROR_NONE) {
+        libssh2_session_last_error(conn.session, &err_msg, &err_code, 0);
+        Log::error() << "Error during SSH password authentication with " << host.host << ": " << err_msg << " (" << err_code << ")";
+        disconnect(conn);
+        return false;
+    }
+    conn.sftp = libssh2_sftp_init(conn.session);
+    if (!conn.sftp) {
+        libssh2_session_last_error(conn.session, &err_msg, &err_code, 0);
+        Log::error() << "Error starting SFTP subsystem on " << host.host << ": " << err_msg << " (" << err_code << ")";
+        disconnect(conn);
+        return false;
+    }
+
+    Log::info() << "SFTP session established to " << host.host << ":" << host.port << " as user " << host.username;
+    return true;
+}
+
+// returns false if the directory could not be listed; sessionLost tells whether the connection has to be rebuilt
+static bool getRemoteDirectoryState(SftpConnection& conn, const std::string& directoryPath, std::map<std::string, RemoteFileState>& state, bool& sessionLost) {
+    sessionLost = false;
+    LIBSSH2_SFTP_HANDLE* dir = libssh2_sftp_opendir(conn.sftp, directoryPath.c_str());
+    if (!dir) {
+        sessionLost = libssh2_session_last_errno(conn.session) != LIBSSH2_ERROR_SFTP_PROTOCOL;
+        return false;
+    }
+
+    std::string prefix = directoryPath;
+    if (prefix.empty() || prefix.back() != '/') {
+        prefix += '/';
+    }
+
+    char name[4096];
+    LIBSSH2_SFTP_ATTRIBUTES attrs;
+    int rc;
+    while ((rc = libssh2_sftp_readdir(dir, name, sizeof(name), &attrs)) > 0) {
+        if ((attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS) && LIBSSH2_SFTP_S_ISREG(attrs.permissions)) {
+            state[prefix + std::string(name, rc)] = {attrs.filesize, attrs.mtime};
+        }
+    }
+    libssh2_sftp_closedir(dir);
+
+    if (rc < 0) {
+        sessionLost = rc != LIBSSH2_ERROR_SFTP_PROTOCOL && rc != LIBSSH2_ERROR_BUFFER_TOO_SMALL;
+        return false;
+    }
+    return true;
+}
+
+static void diffRemoteDirectory(const RemoteHost& host, const std::shared_ptr<RemoteWatch>& watchPtr, std::map<std::string, RemoteFileState>& current_state, std::vector<PendingEvent>& events) {
+    RemoteWatch& watch = *watchPtr;
+    if (!watch.primed) {
+        watch.last_state = std::move(current_state);
+        watch.primed = true;
+        return;
+    }
+
+    for (const auto& [path, current] : current_state) {
+        auto it = watch.last_state.find(path);
+        if (it == watch.last_state.end()) {
+            Log::info() << "Detected remote file created: " << host.host << ":" << path;
+            events.push_back({watchPtr, FileWatcher::FileSystemEventType::Created, path});
+        } else if (it->second != current) {
+            Log::info() << "Detected remote file modified: " << host.host << ":" << path;
+            events.push_back({watchPtr, FileWatcher::FileSystemEventType::Modified, path});
+        }
+    }
+
+    for (const auto& [path, last] : watch.last_state) {
+        if (current_state.find(path) == current_state.end()) {
+            Log::info() << "Detected remote file deleted: " << host.host << ":" << path;
+            events.push_back({watchPtr, FileWatcher::FileSystemEventType::Deleted, path});
+        }
+    }
+
+    watch.last_state = std::move(current_state);
+}
+
+static void dispatchEvents(std::shared_ptr<HostWatcher> hostWatcher) {
+    while (true) {
+        PendingEvent event;
+        {
+            std::unique_lock<std::mutex> lock(hostWatcher->eventsMutex);
+            hostWatcher->eventsReady.wait(lock, [&] { return !hostWatcher->events.empty() || !hostWatcher->polling; });
+            if (hostWatcher->events.empty()) {
+                return;
+            }
+            event = std::move(hostWatcher->events.front());
+            hostWatcher->events.pop_front();
+        }
+        // the trigger may have been stopped while the event was queued
+        if (event.watch->callback && isRunning(event.watch->running)) {
+            event.watch->callback(event.type, event.path);
+        }
+    }
+}
+
+// libssh2_init / libssh2_exit aren't thread-safe, main does them once for the whole process
+static void pollHost(std::string key, std::shared_ptr<HostWatcher> hostWatcher) {
+    const RemoteHost& host = hostWatcher->host;
+    SftpConnection conn;
+
+    while (true) {
+        std::vector<std::shared_ptr<RemoteWatch>> watches;
+        {
+            // the host entry is only dropped while holding hostsMutex, so a concurrent
+            // watchRemoteDirectory either lands in this list or starts a fresh thread
+            std::lock_guard<std::mutex> hostsLock(hostsMutex);
+            std::lock_guard<std::mutex> lock(hostWatcher->mutex);
+            auto& list = hostWatcher->watches;
+            for (auto it = list.begin(); it != list.end();) {
+                it = isRunning((*it)->running) ? it + 1 : list.erase(it);
+            }
+            if (list.empty()) {
+                hosts.erase(key);
+                break;
+            }
+            watches = list;
+        }
+
+        if (!conn.sftp && !connect(host, conn)) {
+            std::this_thread::sleep_for(std::chrono::seconds(5));
+            continue;
+        }
+
+        std::vector<PendingEvent> events;
+        for (const auto& watch : watches) {
+            std::map<std::string, RemoteFileState> current_state;
+            bool sessionLost = false;
+            if (!getRemoteDirectoryState(conn, watch->directoryPath, current_state, sessionLost)) {
+                if (sessionLost) {
+                    Log::error() << "SFTP session to " << host.host << " lost, reconnecting...";
+                    disconnect(conn);
+                    break;
+                }
+                if (!watch->failing) {
+                    Log::error() << "Error: Could not list remote directory " << host.host << ":" << watch->directoryPath;
+                    watch->failing = true;
+                }
+                continue;
+            }
+            watch->failing = false;
+            if (isRunning(watch->running)) {
+                diffRemoteDirectory(host, watch, current_state, events);
+            }
+        }
+        if (!events.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(hostWatcher->eventsMutex);
+                for (auto& event : events) {
+                    hostWatcher->events.push_back(std::move(event));
+                }
+            }
+            hostWatcher->eventsReady.notify_one();
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+
+    disconnect(conn);
+
+    {
+        std::lock_guard<std::mutex> lock(hostWatcher->eventsMutex);
+        hostWatcher->polling = false;
+    }
+    hostWatcher->eventsReady.notify_one();
+}
+
+void watchRemoteDirectory(const RemoteHost& host, const std::string& directoryPath, FileWatcher::FileSystemChangeCallback callback, FileWatcher::RunningFlag running) {
+    auto watch = std::make_shared<RemoteWatch>();
+    watch->directoryPath = directoryPath;
+    watch->callback = callback;
+    watch->running = running;
+
+    std::string key = hostKey(host);
+    std::lock_guard<std::mutex> hostsLock(hostsMutex);
+    auto it = hosts.find(key);
+    if (it != hosts.end()) {
+        std::lock_guard<std::mutex> lock(it->second->mutex);
+        it->second->watches.push_back(watch);
+        return;
+    }
+
+    auto hostWatcher = std::make_shared<HostWatcher>();
+    hostWatcher->host = host;
+    hostWatcher->watches.push_back(watch);
+    hosts[key] = hostWatcher;
+    std::thread(pollHost, key, hostWatcher).detach();
+    std::thread(dispatchEvents, hostWatcher).detach();
+}
+
+}
+}
@@ -0,0 +1,24 @@
+#ifndef THORFINN_REMOTE_FILE_WATCHER_H
+#define THORFINN_REMOTE_FILE_WATCHER_H
+
+#include <string>
+#include "file_watcher.h"
+
+namespace Thorfinn {
+namespace RemoteFileWatcher {
+
+struct RemoteHost {
+    std::string host;
+    int port = 22;
+    std::string username;
+    std::string password;
+};
+
+// all directories watched on the same host share one ssh session, one sftp channel and one polling thread.
+// each poll lists a directory with sftp readdir, which hands back the attributes of every entry in
+// batches, so no extra stat round trip per file is needed.
+void watchRemoteDirectory(const RemoteHost& host, const std::string& directoryPath, FileWatcher::FileSystemChangeCallback callback, FileWatcher::RunningFlag running = nullptr);
+
+}}
+
+#endif
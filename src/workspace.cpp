@@ -0,0 +1,304 @@
+#include "workspace.h"
+#include "logger.h"
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Thorfinn {
+namespace Workspace {
+
+static const char* WORKSPACES_DIR = ".thorfinn/workspaces";
+
+static bool stampFile(const fs::path& path, FileStamp& stamp) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    stamp.device = st.st_dev;
+    stamp.inode = st.st_ino;
+    stamp.size = st.st_size;
+#if defined(__APPLE__)
+    stamp.mtime_sec = st.st_mtimespec.tv_sec;
+    stamp.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_sec = st.st_mtim.tv_sec;
+    stamp.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+static bool reflinkFile(const fs::path& from, const fs::path& to) {
+#if defined(__APPLE__)
+    return clonefile(from.c_str(), to.c_str(), 0) == 0;
+#elif defined(FICLONE)
+    int in = open(from.c_str(), O_RDONLY);
+    if (in < 0) {
+        return false;
+    }
+    struct stat st;
+    fstat(in, &st);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool cloned = ioctl(out, FICLONE, in) == 0;
+    close(out);
+    close(in);
+    if (!cloned) {
+        unlink(to.c_str());
+    }
+    return cloned;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+static bool isUnderOutputs(const std::string& relative, const std::vector<std::string>& outputs) {
+    for (const auto& output : outputs) {
+        if (relative == output || (relative.size() > output.size() && relative.compare(0, output.size(), output) == 0 && relative[output.size()] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// outputs are relative paths inside the working directory. "dist/" and "dist" mean the same thing,
+// anything absolute or climbing out with ".." would let the merge write outside of it.
+static bool normalizeOutput(const std::string& output, std::string& normalized) {
+    fs::path path = fs::path(output).lexically_normal();
+    if (!path.empty() && path.filename().empty()) {
+        path = path.parent_path();
+    }
+    if (path.empty() || path == "." || path.is_absolute() || path.has_root_name()) {
+        return false;
+    }
+    for (const auto& part : path) {
+        if (part == "..") {
+            return false;
+        }
+    }
+    normalized = path.generic_string();
+    return true;
+}
+
+static std::string sanitize(const std::string& name) {
+    std::string result;
+    for (char c : name) {
+        result += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    return result;
+}
+
+// relative path -> stamp for every regular file under the given outputs
+static std::map<std::string, FileStamp> stampOutputs(const fs::path& base, const std::vector<std::string>& outputs) {
+    std::map<std::string, FileStamp> stamps;
+    for (const auto& output : outputs) {
+        fs::path path = base / output;
+        std::error_code ec;
+        if (fs::is_regular_file(fs::symlink_status(path, ec))) {
+            FileStamp stamp;
+            if (stampFile(path, stamp)) {
+                stamps[output] = stamp;
+            }
+        } else if (fs::is_directory(fs::symlink_status(path, ec))) {
+            for (auto it = fs::recursive_directory_iterator(path, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                FileStamp stamp;
+                if (it->is_regular_file() && !it->is_symlink() && stampFile(it->path(), stamp)) {
+                    stamps[it->path().lexically_relative(base).generic_string()] = stamp;
+                }
+            }
+        }
+    }
+    return stamps;
+}
+
+bool create(const std::string& sourceDir, const std::string& stepName, const std::vector<std::string>& outputs, IsolatedWorkspace& workspace) {
+    static std::atomic<unsigned> counter{0};
+
+    fs::path source = fs::absolute(sourceDir).lexically_normal();
+    workspace.sourceDir = source.string();
+    workspace.outputs.clear();
+    for (const auto& output : outputs) {
+        std::string normalized;
+        if (!normalizeOutput(output, normalized)) {
+            Log::error() << "Error: Output '" << output << "' of step '" << stepName << "' must be a relative path inside the working directory.";
+            return false;
+        }
+        workspace.outputs.push_back(normalized);
+    }
+    fs::path root = source / WORKSPACES_DIR / (sanitize(stepName) + "-" + std::to_string(getpid()) + "-" + std::to_string(counter++));
+    workspace.root = root.string();
+
+    size_t linked = 0, reflinked = 0, copied = 0;
+    bool tryReflink = true;
+    try {
+        fs::create_directories(root);
+        workspace.sourceBaseline = stampOutputs(source, workspace.outputs);
+
+        for (auto it = fs::recursive_directory_iterator(source); it != fs::recursive_directory_iterator(); ++it) {
+            fs::path relative = it->path().lexically_relative(source);
+            if (it.depth() == 0 && relative == ".thorfinn") {
+                it.disable_recursion_pending();
+                continue;
+            }
+            fs::path target = root / relative;
+
+            if (it->is_symlink()) {
+                fs::copy_symlink(it->path(), target);
+            } else if (it->is_directory()) {
+                fs::create_directory(target, it->path());
+            } else if (it->is_regular_file()) {
+                if (tryReflink && reflinkFile(it->path(), target)) {
+                    ++reflinked;
+                    continue;
+                }
+                // the first failure means the filesystem can't clone, don't pay for the syscalls again
+                tryReflink = false;
+                if (isUnderOutputs(relative.generic_string(), workspace.outputs)) {
+                    fs::copy_file(it->path(), target);
+                    ++copied;
+                } else {
+                    std::error_code ec;
+                    fs::create_hard_link(it->path(), target, ec);
+                    if (ec) {
+                        // crossing a mount point inside the tree
+                        fs::copy_file(it->path(), target);
+                        ++copied;
+                    } else {
+                        FileStamp stamp;
+                        if (stampFile(target, stamp)) {
+                            workspace.linkedFiles.emplace_back(relative.generic_string(), stamp);
+                        }
+                        ++linked;
+                    }
+                }
+            }
+        }
+
+        workspace.workspaceBaseline = stampOutputs(root, workspace.outputs);
+    } catch (const fs::filesystem_error& e) {
+        Log::error() << "Error creating isolated workspace for step '" << stepName << "': " << e.what();
+        remove(workspace);
+        return false;
+    }
+
+    Log::info() << "Isolated workspace for step '" << stepName << "' at " << workspace.root << " ("
+                << reflinked << " reflinked, " << linked << " hardlinked, " << copied << " copied)";
+    return true;
+}
+
+bool mergeOutputs(const IsolatedWorkspace& workspace) {
+    // overlapping pipelines must not both pass the conflict check before either one has renamed
+    static std::mutex mergeMutex;
+    std::lock_guard<std::mutex> lock(mergeMutex);
+
+    fs::path source(workspace.sourceDir);
+    fs::path root(workspace.root);
+
+    std::map<std::string, FileStamp> workspaceNow = stampOutputs(root, workspace.outputs);
+    std::map<std::string, FileStamp> sourceNow = stampOutputs(source, workspace.outputs);
+
+    auto changed = [](const std::map<std::string, FileStamp>& before, const std::map<std::string, FileStamp>& after, const std::string& path) {
+        auto b = before.find(path);
+        auto a = after.find(path);
+        if (b == before.end() || a == after.end()) {
+            return (b == before.end()) != (a == after.end());
+        }
+        return b->second != a->second;
+    };
+
+    std::set<std::string> paths;
+    for (const auto& [path, stamp] : workspace.workspaceBaseline) paths.insert(path);
+    for (const auto& [path, stamp] : workspaceNow) paths.insert(path);
+
+    std::vector<std::string> toMove, toDelete, conflicts;
+    for (const auto& path : paths) {
+        if (!changed(workspace.workspaceBaseline, workspaceNow, path)) {
+            continue;
+        }
+        if (changed(workspace.sourceBaseline, sourceNow, path)) {
+            conflicts.push_back(path);
+        } else if (workspaceNow.count(path)) {
+            toMove.push_back(path);
+        } else {
+            toDelete.push_back(path);
+        }
+    }
+
+    if (!conflicts.empty()) {
+        for (const auto& path : conflicts) {
+            Log::error() << "Merge conflict: '" << path << "' was changed in both the workspace and " << workspace.sourceDir;
+        }
+        return false;
+    }
+
+    try {
+        for (const auto& path : toMove) {
+            fs::create_directories((source / path).parent_path());
+            // same filesystem, so this is an atomic replace instead of a copy
+            fs::rename(root / path, source / path);
+        }
+        for (const auto& path : toDelete) {
+            fs::remove(source / path);
+        }
+    } catch (const fs::filesystem_error& e) {
+        Log::error() << "Error merging workspace outputs: " << e.what();
+        return false;
+    }
+
+    Log::info() << "Merged " << toMove.size() << " changed and " << toDelete.size() << " deleted output(s) back into " << workspace.sourceDir;
+    return true;
+}
+
+bool checkLinkedFiles(const IsolatedWorkspace& workspace) {
+    fs::path root(workspace.root);
+    std::vector<std::string> writtenThrough;
+    for (const auto& [path, before] : workspace.linkedFiles) {
+        FileStamp after;
+        // a different inode means the step replaced its own link, which is fine
+        if (!stampFile(root / path, after) || after.device != before.device || after.inode != before.inode) {
+            continue;
+        }
+        // ctime is left out on purpose: other workspaces linking and unlinking the same inode bump it
+        if (after.size != before.size || after.mtime_sec != before.mtime_sec || after.mtime_nsec != before.mtime_nsec) {
+            writtenThrough.push_back(path);
+        }
+    }
+
+    for (const auto& path : writtenThrough) {
+        Log::error() << "Isolation broken: '" << path << "' was written in place and changed in " << workspace.sourceDir
+                     << " too. Declare it under 'outputs' if the step writes it.";
+    }
+    return writtenThrough.empty();
+}
+
+void remove(const IsolatedWorkspace& workspace) {
+    if (workspace.root.empty()) {
+        return;
+    }
+    std::error_code ec;
+    // hardlinks only drop a reference, the originals stay untouched
+    fs::remove_all(workspace.root, ec);
+    if (ec) {
+        Log::warn() << "Warning: Could not remove workspace " << workspace.root << ": " << ec.message();
+    }
+}
+
+}
+}
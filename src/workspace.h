@@ -0,0 +1,55 @@
+#ifndef THORFINN_WORKSPACE_H
+#define THORFINN_WORKSPACE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+namespace Thorfinn {
+namespace Workspace {
+
+struct FileStamp {
+    dev_t device = 0;
+    ino_t inode = 0;
+    off_t size = 0;
+    long mtime_sec = 0;
+    long mtime_nsec = 0;
+
+    bool operator==(const FileStamp& other) const {
+        return device == other.device && inode == other.inode && size == other.size &&
+               mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+    }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+struct IsolatedWorkspace {
+    std::string sourceDir;
+    std::string root;
+    std::vector<std::string> outputs;
+    // stamps of every file under 'outputs' taken at setup, relative path -> stamp
+    std::map<std::string, FileStamp> sourceBaseline;
+    std::map<std::string, FileStamp> workspaceBaseline;
+    // every hardlinked file, relative path -> stamp of the shared inode right after linking
+    std::vector<std::pair<std::string, FileStamp>> linkedFiles;
+};
+
+// mirrors sourceDir into <sourceDir>/.thorfinn/workspaces/<step>-<n>. files are reflinked where the
+// filesystem supports it and hardlinked otherwise, so setup cost scales with the number of entries
+// rather than their size. files under 'outputs' are never hardlinked since the step is expected to
+// write them; they get a real copy when reflinks are unavailable.
+bool create(const std::string& sourceDir, const std::string& stepName, const std::vector<std::string>& outputs, IsolatedWorkspace& workspace);
+
+// moves changed outputs back into sourceDir. if any output was also changed in sourceDir since setup,
+// nothing is merged and false is returned.
+bool mergeOutputs(const IsolatedWorkspace& workspace);
+
+// hardlinked files share their inode with the working directory, so a step writing one in place
+// changed the original too. returns false and names every such file.
+bool checkLinkedFiles(const IsolatedWorkspace& workspace);
+
+void remove(const IsolatedWorkspace& workspace);
+
+}}
+
+#endif